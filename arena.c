@@ -0,0 +1,169 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 10:12:40
+ * @LastEditTime: 2026-10-17 10:12:40
+ * @LastEditors: QQYYHH
+ * @Description: bump-pointer arena allocator
+ * @FilePath: /pwn/qcc/arena.c
+ * welcome to my github: https://github.com/QQYYHH
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "qcc.h"
+
+// 每次向系统申请的内存块大小
+#define CHUNK_SIZE (64 * 1024)
+// 小对象按16字节对齐划分为 16, 32, 48, 64 四个大小等级
+#define CLASS_STEP 16
+#define NCLASS 4
+// 大于 CHUNK_SIZE / 4 的对象单独申请一个内存块
+#define LARGE_SIZE (CHUNK_SIZE / 4)
+
+// 对齐到16字节，保证紧跟在块头后面的数据也是16字节对齐的
+typedef struct Chunk
+{
+    struct Chunk *next;
+    char *cur;
+    char *end;
+} __attribute__((aligned(16))) Chunk;
+
+/**
+ * 每个大小等级一个子arena，Ast、Ctype、String 等热点对象各自连续存放
+ * 最后一个子arena存放其它大小的对象
+ */
+struct Arena
+{
+    Chunk *chunks[NCLASS + 1];
+    // 单独申请的大对象
+    Chunk *large;
+    // 每个子arena已分配的字节数
+    size_t used[NCLASS + 1];
+    size_t nalloc[NCLASS + 1];
+    // 当前从系统申请的字节数，以及历史峰值
+    size_t reserved;
+    size_t peak;
+};
+
+/**
+ * 类型、标识符、全局变量和字符串常量等在整个编译过程中都要用到，放在 perm_arena 中
+ * 函数的抽象语法树放在单独的arena中，函数的代码输出之后整体释放
+ */
+Arena *perm_arena;
+// 当前分配所使用的arena
+Arena *cur_arena;
+
+Arena *make_arena(void)
+{
+    Arena *r = calloc(1, sizeof(Arena));
+    if (!r)
+        error("Out of memory");
+    return r;
+}
+
+static Chunk *new_chunk(Arena *arena, Chunk **list, size_t size)
+{
+    Chunk *c = malloc(sizeof(Chunk) + size);
+    if (!c)
+        error("Out of memory");
+    c->cur = (char *)(c + 1);
+    c->end = c->cur + size;
+    c->next = *list;
+    *list = c;
+    arena->reserved += sizeof(Chunk) + size;
+    if (arena->reserved > arena->peak)
+        arena->peak = arena->reserved;
+    return c;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + CLASS_STEP - 1) & ~(size_t)(CLASS_STEP - 1);
+    if (size == 0)
+        size = CLASS_STEP;
+    int cls = size <= NCLASS * CLASS_STEP ? size / CLASS_STEP - 1 : NCLASS;
+    arena->used[cls] += size;
+    arena->nalloc[cls]++;
+    if (size > LARGE_SIZE)
+    {
+        Chunk *c = new_chunk(arena, &arena->large, size);
+        c->cur = c->end;
+        return (char *)(c + 1);
+    }
+    Chunk *c = arena->chunks[cls];
+    if (!c || c->end - c->cur < size)
+        c = new_chunk(arena, &arena->chunks[cls], CHUNK_SIZE);
+    void *r = c->cur;
+    c->cur += size;
+    return r;
+}
+
+static void free_chunks(Chunk *c)
+{
+    while (c)
+    {
+        Chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+/**
+ * @brief 释放arena中分配的所有对象，但每个大小等级保留一个内存块以便复用
+ */
+void arena_reset(Arena *arena)
+{
+    for (int i = 0; i <= NCLASS; i++)
+    {
+        Chunk *c = arena->chunks[i];
+        if (!c)
+            continue;
+        free_chunks(c->next);
+        c->next = NULL;
+        c->cur = (char *)(c + 1);
+    }
+    free_chunks(arena->large);
+    arena->large = NULL;
+    arena->reserved = 0;
+    for (int i = 0; i <= NCLASS; i++)
+        if (arena->chunks[i])
+            arena->reserved += sizeof(Chunk) + (arena->chunks[i]->end - (char *)(arena->chunks[i] + 1));
+}
+
+// 一次性释放arena中的所有内存
+void arena_release(Arena *arena)
+{
+    for (int i = 0; i <= NCLASS; i++)
+        free_chunks(arena->chunks[i]);
+    free_chunks(arena->large);
+    free(arena);
+}
+
+void arena_report(char *name, Arena *arena, FILE *fp)
+{
+    fprintf(fp, "%s: %zu bytes reserved, peak %zu bytes\n", name, arena->reserved, arena->peak);
+    for (int i = 0; i <= NCLASS; i++)
+    {
+        if (i < NCLASS)
+            fprintf(fp, "  class %3d: ", (i + 1) * CLASS_STEP);
+        else
+            fprintf(fp, "  other    : ");
+        fprintf(fp, "%zu allocations, %zu bytes\n", arena->nalloc[i], arena->used[i]);
+    }
+}
+
+// 从 perm_arena 分配内存，内存在编译结束时统一释放
+void *perm_alloc(size_t size)
+{
+    if (!perm_arena)
+        perm_arena = make_arena();
+    return arena_alloc(perm_arena, size);
+}
+
+// 从当前arena分配内存
+void *qalloc(size_t size)
+{
+    if (!cur_arena)
+        return perm_alloc(size);
+    return arena_alloc(cur_arena, size);
+}
@@ -0,0 +1,38 @@
+#!/bin/bash
+###
+ # @Author: QQYYHH
+ # @Date: 2026-10-17 18:58:26
+ # @LastEditTime: 2026-10-17 18:58:26
+ # @LastEditors: QQYYHH
+ # @Description: 循环优化的性能测试
+ # @FilePath: /pwn/qcc/bench/loop_bench.sh
+ # welcome to my github: https://github.com/QQYYHH
+### 
+
+# 用不同的编译选项编译 bench/loops.c，比较运行时间，输出必须相同
+function run {
+  ./qcc $1 bench/loops.c > tmp.s 2>/dev/null || { echo "Failed to compile with $1"; exit 1; }
+  gcc -o tmp.out driver.c tmp.s 2>/dev/null || { echo "GCC failed"; exit 1; }
+  # 取3次运行中最快的一次，减少噪声
+  best=0
+  for i in 1 2 3; do
+    start=`date +%s%N`
+    result="`./tmp.out`"
+    end=`date +%s%N`
+    if [ -n "$expected" ] && [ "$result" != "$expected" ]; then
+      echo "Wrong result with $1: $expected expected but got $result"
+      exit 1
+    fi
+    expected="$result"
+    t=$(( (end - start) / 1000000 ))
+    if [ $best -eq 0 ] || [ $t -lt $best ]; then best=$t; fi
+  done
+  printf "%-40s %6d ms\n" "$1" $best
+}
+
+run "-O1 -fno-rotate-loops -fno-licm"
+run "-O1 -fno-licm"
+run "-O1 -fno-rotate-loops"
+run "-O1"
+run "-O2"
+rm -f tmp.s tmp.out
@@ -0,0 +1,20 @@
+int grid[64][64];
+
+int sweep(int board[][64], int n) {
+  int s = 0;
+  for (int i = 0; i < n; i++)
+    for (int j = 0; j < n; j++)
+      if (board[i][j] < n * n)
+        s = s + board[i][j];
+  return s;
+}
+
+int mymain() {
+  for (int i = 0; i < 64; i++)
+    for (int j = 0; j < 64; j++)
+      grid[i][j] = i * j;
+  int t = 0;
+  for (int r = 0; r < 100000; r++)
+    t = t + sweep(grid, 64) / 1000;
+  return t;
+}
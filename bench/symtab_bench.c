@@ -0,0 +1,71 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 12:05:31
+ * @LastEditTime: 2026-10-17 12:05:31
+ * @LastEditors: QQYYHH
+ * @Description: 符号表查找的性能测试
+ * @FilePath: /pwn/qcc/bench/symtab_bench.c
+ * welcome to my github: https://github.com/QQYYHH
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "../qcc.h"
+
+#define LOOKUPS 2000000
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**
+ * 在一个有 n 个全局符号、若干层嵌套作用域的表里做随机查找
+ * 每次查找的平均耗时应当与 n 无关
+ */
+static void bench(int n)
+{
+    char buf[32];
+    char **names = qalloc(n * sizeof(char *));
+    symtab_push_scope();
+    for (int i = 0; i < n; i++)
+    {
+        snprintf(buf, sizeof(buf), "sym%d", i);
+        names[i] = intern(buf);
+        symtab_define(names[i], (Ast *)names[i]);
+    }
+    // 内层作用域遮盖一部分外层符号，下标模64小于8的符号查到的是内层的NULL
+    for (int d = 0; d < 8; d++)
+    {
+        symtab_push_scope();
+        for (int i = d; i < n; i += 64)
+            symtab_define(names[i], NULL);
+    }
+
+    unsigned seed = 12345;
+    long found = 0;
+    double start = now();
+    for (int i = 0; i < LOOKUPS; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        int k = (seed >> 8) % n;
+        found += symtab_lookup(names[k]) == (k % 64 < 8 ? NULL : (Ast *)names[k]);
+    }
+    double elapsed = now() - start;
+    if (found != LOOKUPS)
+        error("lookup returned a wrong symbol");
+    for (int d = 0; d < 8; d++)
+        symtab_pop_scope();
+    symtab_pop_scope();
+    printf("%8d symbols: %6.1f ns/lookup\n", n, elapsed * 1e9 / LOOKUPS);
+}
+
+int main(int argc, char **argv)
+{
+    cur_arena = make_arena();
+    for (int n = 100; n <= 1000000; n *= 10)
+        bench(n);
+    return 0;
+}
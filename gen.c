@@ -10,12 +10,16 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 #include "qcc.h"
 
 // x64下函数前6个实参会依次放入下列寄存器
 static char *REGS[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
 
 void emit_expr(Ast *ast);
+static void emit_ret(void);
+static void emit_leave(void);
+static void emit_param_reg(Ast *p, int i);
 
 #define emit(...)        emitf(__LINE__, "\t" __VA_ARGS__)
 #define emit_label(...)  emitf(__LINE__, __VA_ARGS__)
@@ -48,7 +52,7 @@ static int ctype_shift(Ctype *ctype)
 }
 
 // 某个ctype占用的字节数
-static int ctype_size(Ctype *ctype)
+int ctype_size(Ctype *ctype)
 {
     switch (ctype->type)
     {
@@ -65,6 +69,726 @@ static int ctype_size(Ctype *ctype)
     }
 }
 
+// ===================== register ====================
+
+/**
+ * -fregister-expr 模式下表达式的中间结果保存在临时寄存器中，而不是每次都 push/pop
+ * 临时寄存器都是callee-saved寄存器，函数调用前后不需要额外保存
+ * -fpromote-regs 提升到寄存器中的局部变量也从这里分配，排在临时寄存器之后
+ * 函数用到的寄存器在函数入口处保存，返回前恢复
+ */
+static char *SCRATCH[] = {"rbx", "r12", "r13", "r14", "r15"};
+#define NSCRATCH (sizeof(SCRATCH) / sizeof(*SCRATCH))
+// 当前函数可以使用的临时寄存器数量，以及已经占用的数量
+static int nscratch;
+static int used_scratch;
+// 当前函数在入口处保存的寄存器数量，临时寄存器 + 局部变量寄存器
+static int nsaved;
+// 当前函数没有建立栈帧，局部变量寻址的基址寄存器，不建立栈帧的叶子函数用rsp
+static bool frameless;
+static char *frame_reg = "rbp";
+// 无栈帧函数在red zone中的栈帧大小，以及溢出到栈帧下方的暂存值个数
+static int frame_size;
+static int spill_depth;
+// 无栈帧函数在red zone中为溢出的暂存值预留的位置数
+#define RED_ZONE_SPILLS 4
+
+// 寄存器的 64位，32位，8位 名称
+static char *REGNAMES[][3] = {
+    {"rax", "eax", "al"},
+    {"rbx", "ebx", "bl"},
+    {"rcx", "ecx", "cl"},
+    {"rdx", "edx", "dl"},
+    {"rsi", "esi", "sil"},
+    {"rdi", "edi", "dil"},
+    {"r8", "r8d", "r8b"},
+    {"r9", "r9d", "r9b"},
+    {"r12", "r12d", "r12b"},
+    {"r13", "r13d", "r13b"},
+    {"r14", "r14d", "r14b"},
+    {"r15", "r15d", "r15b"},
+};
+
+// 根据数据大小获取寄存器对应的名称
+static char *regname(char *reg, int size)
+{
+    for (int i = 0; i < sizeof(REGNAMES) / sizeof(*REGNAMES); i++)
+    {
+        if (strcmp(REGNAMES[i][0], reg))
+            continue;
+        switch (size)
+        {
+        case 1:
+            return REGNAMES[i][2];
+        case 4:
+            return REGNAMES[i][1];
+        default:
+            return REGNAMES[i][0];
+        }
+    }
+    error("internal error: unknown register %s", reg);
+}
+
+/**
+ * 寄存器中运算的宽度
+ * int 和 char 都按照32位运算，寄存器的高32位始终为0；指针按照64位运算
+ */
+static int opsize(Ctype *ctype)
+{
+    return (ctype->type == CTYPE_PTR || ctype->type == CTYPE_ARRAY) ? 8 : 4;
+}
+
+// 操作数可以是立即数或者内存
+#define OPND_IMM 1
+#define OPND_MEM 2
+
+/**
+ * @brief 不需要寄存器就能直接作为指令源操作数的表达式
+ * 比如整数字面量，int 或者指针类型的变量
+ * @param size 指令的操作宽度，变量的大小必须与之一致
+ * @return 操作数，NULL表示不能直接作为操作数
+ */
+static char *simple_operand(Ast *ast, int size, int allow)
+{
+    String *s = make_string();
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+        if (!(allow & OPND_IMM))
+            return NULL;
+        string_appendf(s, "$%d", ast->ctype->type == CTYPE_CHAR ? (unsigned char)ast->c : ast->ival);
+        return get_cstring(s);
+    case AST_LVAR:
+    case AST_GVAR:
+        // 寄存器中的 char 已经零扩展，可以直接作为32位操作数
+        if (ast->type == AST_LVAR && ast->lreg && opsize(ast->ctype) == size)
+        {
+            string_appendf(s, "%%%s", regname(ast->lreg, size));
+            return get_cstring(s);
+        }
+        if (!(allow & OPND_MEM) || ast->ctype->type == CTYPE_ARRAY || ctype_size(ast->ctype) != size)
+            return NULL;
+        if (ast->type == AST_LVAR)
+            string_appendf(s, "-%d(%%%s)", ast->loff, frame_reg);
+        else
+            string_appendf(s, "%s(%%rip)", ast->glabel);
+        return get_cstring(s);
+    default:
+        return NULL;
+    }
+}
+
+static int max(int a, int b)
+{
+    return a > b ? a : b;
+}
+
+// 字面量和变量，可以直接加载到任意寄存器中，不会用到其它寄存器
+static bool is_leaf(Ast *ast)
+{
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief 将字面量或变量加载到寄存器reg中，数组只加载首地址
+ * int 和 char 加载到32位寄存器，高32位自动清零
+ */
+static void emit_load_leaf(Ast *ast, char *reg)
+{
+    String *s = make_string();
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+        emit("mov %s, %%%s", simple_operand(ast, 4, OPND_IMM), regname(reg, 4));
+        return;
+    case AST_STRING:
+        emit("lea %s(%%rip), %%%s", ast->slabel, reg);
+        return;
+    case AST_LVAR:
+        if (ast->lreg)
+        {
+            int size = opsize(ast->ctype);
+            emit("mov %%%s, %%%s", regname(ast->lreg, size), regname(reg, size));
+            return;
+        }
+        string_appendf(s, "-%d(%%%s)", ast->loff, frame_reg);
+        break;
+    case AST_GVAR:
+        string_appendf(s, "%s(%%rip)", ast->glabel);
+        break;
+    default:
+        error("internal error");
+    }
+    char *mem = get_cstring(s);
+    if (ast->ctype->type == CTYPE_ARRAY)
+    {
+        emit("lea %s, %%%s", mem, reg);
+        return;
+    }
+    switch (ctype_size(ast->ctype))
+    {
+    case 1:
+        emit("movzbl %s, %%%s", mem, regname(reg, 4));
+        break;
+    case 4:
+        emit("mov %s, %%%s", mem, regname(reg, 4));
+        break;
+    default:
+        emit("mov %s, %%%s", mem, reg);
+    }
+}
+
+static int need(Ast *ast);
+
+// 计算二元运算所需寄存器的数量，右操作数是字面量或变量时不需要额外的寄存器
+static int need_pair(Ast *left, Ast *right)
+{
+    int l = need(left);
+    if (is_leaf(right))
+        return l;
+    if (is_leaf(left))
+        return need(right);
+    int r = need(right);
+    return l == r ? l + 1 : max(l, r);
+}
+
+/**
+ * @brief Sethi-Ullman 编号，即不溢出到栈上的情况下，计算表达式需要的寄存器数量（包括rax）
+ * 对于语句，返回其中所有表达式的最大值
+ */
+static int need(Ast *ast)
+{
+    if (!ast)
+        return 0;
+    int r = 1;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+    case AST_ADDR:
+        return 1;
+    case AST_DEREF:
+    case '!':
+        return need(ast->operand);
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        if (ast->operand->type == AST_DEREF)
+            return need(ast->operand->operand);
+        return 1;
+    case AST_FUNCALL:
+        if (flag_call_args)
+        {
+            // 前面的参数暂存在临时寄存器中，再计算后面的参数
+            int held = 0;
+            for (int i = 0; i < vec_len(ast->args); i++)
+            {
+                Ast *arg = vec_get(ast->args, i);
+                if (!is_leaf(arg))
+                    r = max(r, held++ + need(arg));
+            }
+            return r;
+        }
+        for (int i = 0; i < vec_len(ast->args); i++)
+            r = max(r, need(vec_get(ast->args, i)));
+        return r;
+    case AST_DECL:
+        if (ast->decl_init && ast->decl_init->type == AST_ARRAY_INIT)
+        {
+            for (int i = 0; i < vec_len(ast->decl_init->array_init); i++)
+                r = max(r, need(vec_get(ast->decl_init->array_init, i)));
+            return r;
+        }
+        return need(ast->decl_init);
+    case AST_IF:
+        return max(need(ast->cond), max(need(ast->then), need(ast->els)));
+    case AST_FOR:
+        r = max(need(ast->forinit), need(ast->forcond));
+        return max(r, max(need(ast->forstep), need(ast->forbody)));
+    case AST_RET:
+        return need(ast->retval);
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            r = max(r, need(vec_get(ast->stmts, i)));
+        return r;
+    case '=':
+        if (ast->left->type == AST_DEREF)
+            return need_pair(ast->left->operand, ast->right);
+        return need(ast->right);
+    default:
+        // 二元运算
+        return need_pair(ast->left, ast->right);
+    }
+}
+
+/**
+ * @brief 暂存rax中的值，优先放在空闲的临时寄存器中，寄存器不够时溢出到栈上
+ * @return 暂存的寄存器，NULL表示已经压栈
+ */
+static char *hold_rax(void)
+{
+    if (used_scratch < nscratch)
+    {
+        char *reg = SCRATCH[used_scratch++];
+        emit("mov %%rax, %%%s", reg);
+        return reg;
+    }
+    // 压栈会覆盖red zone中的局部变量，无栈帧函数溢出到栈帧下方预留的位置
+    if (frameless)
+    {
+        if (spill_depth == RED_ZONE_SPILLS)
+            error("internal error: red zone spill slots exhausted");
+        emit("mov %%rax, -%d(%%rsp)", frame_size + ++spill_depth * 8);
+        return NULL;
+    }
+    emit("push %%rax");
+    return NULL;
+}
+
+/**
+ * @brief 取回 hold_rax 暂存的值
+ * @param spill 值在栈上时弹出到这个寄存器
+ * @return 值所在的寄存器
+ */
+static char *unhold(char *held, char *spill)
+{
+    if (held)
+    {
+        used_scratch--;
+        return held;
+    }
+    if (frameless)
+        emit("mov -%d(%%rsp), %%%s", frame_size + spill_depth-- * 8, spill);
+    else
+        emit("pop %%%s", spill);
+    return spill;
+}
+
+/**
+ * @brief 按照 Sethi-Ullman 编号决定求值顺序，先计算需要寄存器多的子树
+ * 计算结束后 left 的值在rax中，返回 right 对应的源操作数
+ * @param size 操作宽度
+ * @param allow 右操作数是否可以是立即数或内存
+ * @param commutative 运算满足交换律时，也可以把 right 的值放在rax中
+ * @param swapped 如果交换了左右操作数，置为true
+ */
+static char *emit_operands(Ast *left, Ast *right, int size, int allow, bool commutative, bool *swapped)
+{
+    String *s = make_string();
+    if (swapped)
+        *swapped = false;
+    char *opnd = simple_operand(right, size, allow);
+    if (opnd)
+    {
+        emit_expr(left);
+        return opnd;
+    }
+    if (is_leaf(right))
+    {
+        emit_expr(left);
+        emit_load_leaf(right, "rcx");
+        string_appendf(s, "%%%s", regname("rcx", size));
+        return get_cstring(s);
+    }
+    // 左操作数是字面量或变量时，先计算右操作数，再直接加载左操作数
+    if (is_leaf(left))
+    {
+        emit_expr(right);
+        opnd = simple_operand(left, size, allow);
+        if (commutative && swapped && opnd)
+        {
+            *swapped = true;
+            return opnd;
+        }
+        emit("mov %%rax, %%rcx");
+        emit_load_leaf(left, "rax");
+        string_appendf(s, "%%%s", regname("rcx", size));
+        return get_cstring(s);
+    }
+    if (need(right) > need(left))
+    {
+        emit_expr(right);
+        char *held = hold_rax();
+        emit_expr(left);
+        string_appendf(s, "%%%s", regname(unhold(held, "rcx"), size));
+        return get_cstring(s);
+    }
+    emit_expr(left);
+    char *held = hold_rax();
+    emit_expr(right);
+    if (commutative && swapped)
+    {
+        *swapped = true;
+        string_appendf(s, "%%%s", regname(unhold(held, "rcx"), size));
+        return get_cstring(s);
+    }
+    emit("mov %%rax, %%rcx");
+    if (held)
+        emit("mov %%%s, %%rax", unhold(held, NULL));
+    else
+        unhold(held, "rax");
+    string_appendf(s, "%%%s", regname("rcx", size));
+    return get_cstring(s);
+}
+
+/**
+ * @brief 从内存操作数 mem 加载数据到rax
+ */
+static void emit_load_deref(Ctype *ctype, char *mem)
+{
+    switch (ctype_size(ctype))
+    {
+    case 1:
+        emit("movzbl %s, %%eax", mem);
+        break;
+    case 4:
+        emit("mov %s, %%eax", mem);
+        break;
+    default:
+        emit("mov %s, %%rax", mem);
+    }
+}
+
+// 整数或字符字面量的值
+static int literal_value(Ast *ast)
+{
+    return ast->ctype->type == CTYPE_CHAR ? (unsigned char)ast->c : ast->ival;
+}
+
+// 2的幂次返回指数，否则返回-1
+static int log2_exact(int c)
+{
+    if (c <= 0 || (c & (c - 1)))
+        return -1;
+    int k = 0;
+    while ((1 << k) < c)
+        k++;
+    return k;
+}
+
+/**
+ * @brief -fstrength-reduce: 用移位和lea代替寄存器 reg 乘以常数 c
+ * 支持 2^k，{3,5,9} * 2^k，以及 {3,5,9} * {3,5,9}
+ * @param size 操作宽度，4 或 8
+ * @return false 表示没有更好的指令序列，由调用者使用imul
+ */
+static bool emit_mul_const(char *reg, int size, int c)
+{
+    if (!flag_strength_reduce || c < 0)
+        return false;
+    char *r = regname(reg, size);
+    if (c == 0)
+    {
+        emit("xor %%%s, %%%s", regname(reg, 4), regname(reg, 4));
+        return true;
+    }
+    static int factors[] = {9, 5, 3, 1};
+    for (int i = 0; i < 4; i++)
+    {
+        int f = factors[i];
+        if (c % f)
+            continue;
+        int k = log2_exact(c / f);
+        int g = -1;
+        if (k < 0)
+        {
+            // 两个lea
+            for (int j = 0; j < 3 && g < 0; j++)
+                if (f > 1 && c / f == factors[j])
+                    g = factors[j];
+            if (g < 0)
+                continue;
+        }
+        if (f > 1)
+            emit("lea (%%%s,%%%s,%d), %%%s", reg, reg, f - 1, r);
+        if (g > 0)
+            emit("lea (%%%s,%%%s,%d), %%%s", reg, reg, g - 1, r);
+        else if (k > 0)
+            emit("shl $%d, %%%s", k, r);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief 计算 Hacker's Delight 中有符号32位除法的魔数
+ * n / d 等于 n 乘以魔数 m 取高32位，算术右移 s 位，再对负数加1
+ */
+static void signed_magic(int d, int *m, int *s)
+{
+    const unsigned two31 = 0x80000000u;
+    unsigned ad = d;
+    unsigned anc = two31 - 1 - two31 % ad;
+    int p = 31;
+    unsigned q1 = two31 / anc, r1 = two31 - q1 * anc;
+    unsigned q2 = two31 / ad, r2 = two31 - q2 * ad;
+    unsigned delta;
+    do
+    {
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
+        {
+            q1++;
+            r1 -= anc;
+        }
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
+        {
+            q2++;
+            r2 -= ad;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+    *m = (int)(q2 + 1);
+    *s = p - 32;
+}
+
+/**
+ * @brief -fstrength-reduce: eax 中的 int 除以正的常数 c，商在eax中，用到rcx
+ * 2的幂次用移位，结果向0取整；其它常数乘以魔数
+ * @return false 表示由调用者使用idiv
+ */
+static bool emit_div_const(int c)
+{
+    if (!flag_strength_reduce || c <= 0)
+        return false;
+    if (c == 1)
+        return true;
+    int k = log2_exact(c);
+    if (k > 0)
+    {
+        // 负数先加上 c-1，使算术右移向0取整
+        emit("mov %%eax, %%ecx");
+        if (k > 1)
+            emit("sar $31, %%ecx");
+        emit("shr $%d, %%ecx", 32 - k);
+        emit("add %%ecx, %%eax");
+        emit("sar $%d, %%eax", k);
+        return true;
+    }
+    int m, s;
+    signed_magic(c, &m, &s);
+    emit("movslq %%eax, %%rcx");
+    emit("imul $%d, %%rcx, %%rcx", m);
+    if (m >= 0)
+        emit("sar $%d, %%rcx", 32 + s);
+    else
+    {
+        // 魔数超过了 int 的范围，按负数相乘之后要再加上被除数
+        emit("sar $32, %%rcx");
+        emit("add %%eax, %%ecx");
+        if (s)
+            emit("sar $%d, %%ecx", s);
+    }
+    emit("shr $31, %%eax");
+    emit("add %%ecx, %%eax");
+    return true;
+}
+
+/**
+ * 内存操作数 base + index * scale + disp
+ * 数组下标展开成的指针加法，以及数组退化为指针的解引用，都可以折叠到x86的寻址模式中
+ */
+typedef struct
+{
+    Ast *base;
+    // 没有变址时为NULL
+    Ast *index;
+    int scale;
+    int disp;
+} Addr;
+
+/**
+ * @brief 把指针表达式拆分为基址、变址和偏移
+ * 字面量下标折叠到偏移中，最外层的非字面量下标作为变址
+ */
+static void decompose_addr(Ast *ast, Addr *a)
+{
+    a->index = NULL;
+    a->scale = 1;
+    a->disp = 0;
+    for (;;)
+    {
+        // a[i][j] 中 a[i] 是数组，值就是它的地址
+        if (ast->type == AST_DEREF && ast->ctype->type == CTYPE_ARRAY)
+        {
+            ast = ast->operand;
+            continue;
+        }
+        if ((ast->type == '+' || ast->type == '-') && ast->ctype->type == CTYPE_PTR &&
+            ast->right->ctype->type != CTYPE_PTR)
+        {
+            int sz = ctype_size(ast->left->ctype->ptr);
+            if (ast->right->type == AST_LITERAL)
+            {
+                a->disp += (ast->type == '+' ? 1 : -1) * literal_value(ast->right) * sz;
+                ast = ast->left;
+                continue;
+            }
+            if (!a->index && ast->type == '+')
+            {
+                a->index = ast->right;
+                a->scale = sz;
+                ast = ast->left;
+                continue;
+            }
+        }
+        break;
+    }
+    a->base = ast;
+}
+
+/**
+ * @brief 基址不需要计算就能出现在寻址模式中
+ * 局部数组相对rbp寻址，寄存器中的指针直接作为基址寄存器
+ * 全局数组和字符串相对rip寻址，但这时不能再有变址寄存器
+ */
+static bool is_fixed_base(Ast *base, bool has_index)
+{
+    if (base->type == AST_LVAR)
+        return base->ctype->type == CTYPE_ARRAY || base->lreg;
+    if (base->type == AST_GVAR)
+        return base->ctype->type == CTYPE_ARRAY && !has_index;
+    return base->type == AST_STRING && !has_index;
+}
+
+/**
+ * @brief 把下标符号扩展到64位寄存器 reg 中
+ * 寄存器中的 char 已经零扩展，copy 为false时直接使用变量所在的寄存器
+ * @return 下标所在的寄存器
+ */
+static char *emit_index(Ast *index, char *reg, bool copy)
+{
+    bool is_char = index->ctype->type == CTYPE_CHAR;
+    if (index->type == AST_LVAR && index->lreg)
+    {
+        if (is_char && !copy)
+            return index->lreg;
+        if (is_char)
+            emit("mov %%%s, %%%s", regname(index->lreg, 4), regname(reg, 4));
+        else
+            emit("movslq %%%s, %%%s", regname(index->lreg, 4), reg);
+        return reg;
+    }
+    if (index->type == AST_LVAR || index->type == AST_GVAR)
+    {
+        char *mem = simple_operand(index, ctype_size(index->ctype), OPND_MEM);
+        if (is_char)
+            emit("movzbl %s, %%%s", mem, regname(reg, 4));
+        else
+            emit("movslq %s, %%%s", mem, reg);
+        return reg;
+    }
+    emit_expr(index);
+    if (!is_char)
+        emit("movslq %%eax, %%%s", reg);
+    else if (strcmp(reg, "rax"))
+        emit("mov %%eax, %%%s", regname(reg, 4));
+    return reg;
+}
+
+/**
+ * @brief 计算指针表达式对应的内存操作数，需要的寄存器只用rax和rcx
+ * 返回的操作数中可能用到暂存寄存器，必须在计算其它表达式之前使用
+ */
+static char *emit_address(Ast *ast)
+{
+    Addr a;
+    decompose_addr(ast, &a);
+    Ast *base = a.base;
+    char *breg = NULL, *ireg = NULL;
+    // 比例因子只能是 1 2 4 8，其它的先乘到变址寄存器中
+    bool mul = a.scale != 1 && a.scale != 2 && a.scale != 4 && a.scale != 8;
+    bool fixed = is_fixed_base(base, a.index);
+    if (!a.index)
+    {
+        if (!fixed)
+        {
+            emit_expr(base);
+            breg = "rax";
+        }
+    }
+    else if (fixed)
+        ireg = emit_index(a.index, "rax", mul);
+    else if (is_leaf(a.index))
+    {
+        emit_expr(base);
+        breg = "rax";
+        ireg = emit_index(a.index, "rcx", mul);
+    }
+    else if (need(a.index) > need(base))
+    {
+        // 基址和下标都需要计算，先计算需要寄存器多的一个
+        emit_index(a.index, "rax", true);
+        char *held = hold_rax();
+        emit_expr(base);
+        breg = "rax";
+        ireg = unhold(held, "rcx");
+    }
+    else
+    {
+        emit_expr(base);
+        char *held = hold_rax();
+        ireg = emit_index(a.index, "rax", true);
+        breg = unhold(held, "rcx");
+    }
+    if (mul)
+    {
+        if (!emit_mul_const(ireg, 8, a.scale))
+            emit("imul $%d, %%%s", a.scale, ireg);
+        a.scale = 1;
+    }
+
+    String *s = make_string();
+    if (fixed && base->type != AST_LVAR)
+    {
+        // 相对rip寻址
+        char *label = base->type == AST_GVAR ? base->glabel : base->slabel;
+        if (a.disp)
+            string_appendf(s, "%s%+d(%%rip)", label, a.disp);
+        else
+            string_appendf(s, "%s(%%rip)", label);
+        return get_cstring(s);
+    }
+    if (fixed)
+    {
+        if (base->lreg)
+            breg = base->lreg;
+        else
+        {
+            breg = frame_reg;
+            a.disp -= base->loff;
+        }
+    }
+    if (a.disp)
+        string_appendf(s, "%d", a.disp);
+    string_appendf(s, "(%%%s", breg);
+    if (ireg)
+        string_appendf(s, ",%%%s,%d", ireg, a.scale);
+    string_appendf(s, ")");
+    return get_cstring(s);
+}
+
+// 把内存操作数的地址加载到rax中
+static void emit_lea(char *mem)
+{
+    if (strcmp(mem, "(%rax)"))
+        emit("lea %s, %%rax", mem);
+}
+
 /**
  * 全局数据加载
  * 如果是数组，则仅加载首元素地址
@@ -112,7 +836,7 @@ static void emit_lload(Ctype *ctype, int loff)
 {
     /* 如果是数组，将最终根据偏移量计算得到的地址 加载到rax */
     if(ctype->type == CTYPE_ARRAY){
-        emit("lea -%d(%%rbp), %%rax", loff);
+        emit("lea -%d(%%%s), %%rax", loff, frame_reg);
         return;
     }
     /* 其他类型*/
@@ -121,14 +845,14 @@ static void emit_lload(Ctype *ctype, int loff)
     {
     case 1:
         emit("xor %%rax, %%rax");
-        emit("mov -%d(%%rbp), %%al", loff);
+        emit("mov -%d(%%%s), %%al", loff, frame_reg);
         break;
     case 4:
         emit("xor %%rax, %%rax");
-        emit("mov -%d(%%rbp), %%eax", loff);
+        emit("mov -%d(%%%s), %%eax", loff, frame_reg);
         break;
     case 8:
-        emit("mov -%d(%%rbp), %%rax", loff);
+        emit("mov -%d(%%%s), %%rax", loff, frame_reg);
         break;
     default:
         error("Unknown data size: %s: %d", ctype_to_string(ctype), size);
@@ -187,7 +911,189 @@ static void emit_lsave(Ctype *ctype, int loff, int off)
         reg = "rax";
         break;
     }
-    emit("mov %%%s, -%d(%%rbp)", reg, loff + off * size);
+    emit("mov %%%s, -%d(%%%s)", reg, loff + off * size, frame_reg);
+}
+
+/**
+ * 将rax中的值保存到局部变量中，局部变量可能在寄存器中
+ * 寄存器中的 int 和 char 保持零扩展
+ */
+static void emit_lvar_save(Ast *var)
+{
+    if (!var->lreg)
+    {
+        emit_lsave(var->ctype, var->loff, 0);
+        return;
+    }
+    switch (ctype_size(var->ctype))
+    {
+    case 1:
+        emit("movzbl %%al, %%%s", regname(var->lreg, 4));
+        break;
+    case 4:
+        emit("mov %%eax, %%%s", regname(var->lreg, 4));
+        break;
+    default:
+        emit("mov %%rax, %%%s", var->lreg);
+    }
+}
+
+// ===================== bulk init ====================
+
+// 超过这个字节数的拷贝和清零用 rep movsb / rep stosb，否则展开成 16/8/4/1 字节的 mov
+#define BULK_REP_SIZE 256
+
+// 当前函数中放到 .rodata 的数组初始值，以及它们的标签，函数结束后统一输出
+static Vector *init_data;
+static Vector *init_labels;
+
+/**
+ * @brief 从 label 拷贝 [from, to) 字节到局部数组中，label 为NULL时清零
+ * @param loff 数组相对于栈帧基址的偏移，第k个字节在 -(loff - k)
+ */
+static void emit_block_move(char *label, int loff, int from, int to)
+{
+    static int widths[] = {16, 8, 4, 1};
+    if (!label && to - from >= 16)
+        emit("pxor %%xmm0, %%xmm0");
+    if (!label && (to - from) % 16)
+        emit("xor %%eax, %%eax");
+    for (int i = 0; i < sizeof(widths) / sizeof(*widths); i++)
+    {
+        int w = widths[i];
+        char *op = w == 16 ? "movdqu" : "mov";
+        char *reg = w == 16 ? "xmm0" : regname("rax", w);
+        for (; to - from >= w; from += w)
+        {
+            if (label && from)
+                emit("%s %s+%d(%%rip), %%%s", op, label, from, reg);
+            else if (label)
+                emit("%s %s(%%rip), %%%s", op, label, reg);
+            emit("%s %%%s, -%d(%%%s)", op, reg, loff - from, frame_reg);
+        }
+    }
+}
+
+/**
+ * @brief 局部数组的前 n 个字节从 label 拷贝，剩下的清零
+ * 字节数较多时用串操作，rdi 和 rsi 可能保存着参数，暂存到 r10 和 r11 中
+ */
+static void emit_block_init(char *label, int loff, int n, int size)
+{
+    if (n <= BULK_REP_SIZE && size - n <= BULK_REP_SIZE)
+    {
+        emit_block_move(label, loff, 0, n);
+        emit_block_move(NULL, loff, n, size);
+        return;
+    }
+    emit("mov %%rdi, %%r10");
+    emit("mov %%rsi, %%r11");
+    emit("lea -%d(%%%s), %%rdi", loff, frame_reg);
+    if (n)
+    {
+        emit("lea %s(%%rip), %%rsi", label);
+        emit("mov $%d, %%ecx", n);
+        emit("rep movsb");
+    }
+    if (size > n)
+    {
+        emit("xor %%eax, %%eax");
+        emit("mov $%d, %%ecx", size - n);
+        emit("rep stosb");
+    }
+    emit("mov %%r11, %%rsi");
+    emit("mov %%r10, %%rdi");
+}
+
+// 数组的 {} 初始值是否都是整数或字符常量
+static bool is_const_init(Vector *init)
+{
+    for (int i = 0; i < vec_len(init); i++)
+        if (((Ast *)vec_get(init, i))->type != AST_LITERAL)
+            return false;
+    return true;
+}
+
+// 两个数组声明的常量初始值是否生成相同的数据
+static bool same_init(Ast *a, Ast *b)
+{
+    Vector *x = a->decl_init->array_init, *y = b->decl_init->array_init;
+    if (ctype_size(get_array_element_ctype(a->decl_var->ctype)) !=
+            ctype_size(get_array_element_ctype(b->decl_var->ctype)) ||
+        vec_len(x) != vec_len(y))
+        return false;
+    for (int i = 0; i < vec_len(x); i++)
+        if (literal_value(vec_get(x, i)) != literal_value(vec_get(y, i)))
+            return false;
+    return true;
+}
+
+/**
+ * @brief 用整块拷贝初始化局部数组
+ * 字符串本身已经在 .rodata 中，常量 {} 初始值在函数结束后输出到 .rodata
+ * 非常量的 {} 初始值逐个元素保存，只把没有初始值的部分整块清零
+ * @return 是否已经生成了初始化代码
+ */
+static bool emit_bulk_init(Ast *ast)
+{
+    Ast *var = ast->decl_var, *init = ast->decl_init;
+    int size = ctype_size(var->ctype);
+    if (init->type == AST_STRING)
+    {
+        int n = strlen(init->sval) + 1;
+        emit_block_init(init->slabel, var->loff, n < size ? n : size, size);
+        return true;
+    }
+    Ctype *elem = get_array_element_ctype(var->ctype);
+    int n = vec_len(init->array_init) * ctype_size(elem);
+    if (!is_const_init(init->array_init))
+    {
+        for (int i = 0; i < vec_len(init->array_init); i++)
+        {
+            emit_expr(vec_get(init->array_init, i));
+            emit_lsave(elem, var->loff, -i);
+        }
+        emit_block_move(NULL, var->loff, n, size);
+        return true;
+    }
+    // 循环展开之后同一个声明会被复制多次，相同的初始值共用一份数据
+    char *label = NULL;
+    for (int i = 0; i < vec_len(init_data) && !label; i++)
+        if (same_init(vec_get(init_data, i), ast))
+            label = vec_get(init_labels, i);
+    if (!label)
+    {
+        label = make_next_label();
+        vec_push(init_data, ast);
+        vec_push(init_labels, label);
+    }
+    emit_block_init(label, var->loff, n, size);
+    return true;
+}
+
+// 输出当前函数中局部数组的常量初始值
+static void emit_init_data(void)
+{
+    if (!vec_len(init_data))
+        return;
+    emit(".section .rodata");
+    for (int i = 0; i < vec_len(init_data); i++)
+    {
+        Ast *ast = vec_get(init_data, i);
+        Vector *init = ast->decl_init->array_init;
+        emit_label("%s:", (char *)vec_get(init_labels, i));
+        int size = ctype_size(get_array_element_ctype(ast->decl_var->ctype));
+        for (int j = 0; j < vec_len(init); j++)
+        {
+            int val = literal_value(vec_get(init, j));
+            if (size == 1)
+                emit(".byte %d", val);
+            else if (size == 4)
+                emit(".long %d", val);
+            else
+                emit(".quad %d", val);
+        }
+    }
 }
 
 /**
@@ -273,7 +1179,7 @@ static void emit_assign(Ast *var)
     switch (var->type)
     {
     case AST_LVAR:
-        emit_lsave(var->ctype, var->loff, 0);
+        emit_lvar_save(var);
         break;
     case AST_GVAR:
         emit_gsave(var->ctype, var->glabel);
@@ -297,11 +1203,216 @@ static void emit_comp(char *inst, Ast *a, Ast *b){
     emit("movzb %%al, %%rax");
 }
 
+/**
+ * @brief -fscaled-index 模式下的赋值 *addr = value，直接保存到折叠后的内存操作数
+ * 先计算要保存的值，字面量和寄存器中的变量不需要计算
+ */
+static void emit_assign_mem(Ast *ast)
+{
+    static char suffix[] = {[1] = 'b', [4] = 'l', [8] = 'q'};
+    Ast *addr = ast->left->operand, *right = ast->right;
+    int size = ctype_size(ast->left->ctype);
+    if (right->type == AST_LITERAL)
+    {
+        char *mem = emit_address(addr);
+        int val = literal_value(right);
+        emit("mov%c $%d, %s", suffix[size], size == 1 ? (unsigned char)val : val, mem);
+        emit("mov $%d, %%eax", val);
+        return;
+    }
+    if (right->type == AST_LVAR && right->lreg)
+    {
+        char *mem = emit_address(addr);
+        emit("mov %%%s, %s", regname(right->lreg, size), mem);
+        emit("mov %%%s, %%%s", right->lreg, "rax");
+        return;
+    }
+    emit_expr(right);
+    char *held = hold_rax();
+    if (!held)
+    {
+        // 没有空闲的暂存寄存器，值已经压栈，地址放在rax中
+        emit_lea(emit_address(addr));
+        unhold(held, "rcx");
+        emit("mov %%%s, (%%rax)", regname("rcx", size));
+        emit("mov %%rcx, %%rax");
+        return;
+    }
+    char *mem = emit_address(addr);
+    emit("mov %%%s, %s", regname(held, size), mem);
+    emit("mov %%%s, %%rax", held);
+    unhold(held, NULL);
+}
+
+/**
+ * @brief -fregister-expr 模式下的赋值 *addr = value
+ * 赋值之后rax中是所赋的值
+ */
+static void emit_assign_deref_reg(Ast *ast)
+{
+    if (flag_scaled_index)
+    {
+        emit_assign_mem(ast);
+        return;
+    }
+    Ast *addr = ast->left->operand;
+    int size = ctype_size(ast->left->ctype);
+    if (need(ast->right) > need(addr))
+    {
+        emit_expr(ast->right);
+        char *held = hold_rax();
+        emit_expr(addr);
+        char *val = unhold(held, "rcx");
+        emit("mov %%%s, (%%rax)", regname(val, size));
+        emit("mov %%%s, %%rax", val);
+        return;
+    }
+    emit_expr(addr);
+    char *held = hold_rax();
+    emit_expr(ast->right);
+    emit("mov %%%s, (%%%s)", regname("rax", size), unhold(held, "rcx"));
+}
+
+/**
+ * @brief -fregister-expr 模式下的指针运算
+ * 指针 +- 整数时，整数先做符号扩展，再乘以指针指向类型的大小
+ */
+static void emit_pointer_arithmetic_reg(Ast *ast)
+{
+    char *op = ast->type == '+' ? "add" : "sub";
+    Ast *left = ast->left, *right = ast->right;
+    if (right->ctype->type == CTYPE_PTR)
+    {
+        if (ast->type == '+')
+            error("No meaning for ptr plus ptr");
+        char *opnd = emit_operands(left, right, 8, OPND_MEM, false, NULL);
+        emit("sub %s, %%rax", opnd);
+        emit("sar $%d, %%rax", ctype_shift(left->ctype->ptr));
+        return;
+    }
+    if (flag_scaled_index)
+    {
+        // 能折叠成寻址模式时，用一条lea计算地址
+        Addr a;
+        decompose_addr(ast, &a);
+        if (a.base != ast)
+        {
+            emit_lea(emit_address(ast));
+            return;
+        }
+    }
+    int sz = ctype_size(left->ctype->ptr);
+    if (right->type == AST_LITERAL)
+    {
+        emit_expr(left);
+        emit("%s $%d, %%rax", op, literal_value(right) * sz);
+        return;
+    }
+    char *opnd = emit_operands(left, right, 4, 0, false, NULL);
+    emit("movslq %s, %%rcx", opnd);
+    if (sz > 1 && !emit_mul_const("rcx", 8, sz))
+        emit("imul $%d, %%rcx", sz);
+    emit("%s %%rcx, %%rax", op);
+}
+
+/**
+ * @brief -fregister-expr 模式下的二元运算，中间结果放在寄存器中
+ */
+static void emit_binop_reg(Ast *ast)
+{
+    if (ast->type == '=')
+    {
+        if (ast->left->type == AST_DEREF)
+        {
+            emit_assign_deref_reg(ast);
+            return;
+        }
+        emit_expr(ast->right);
+        emit_assign(ast->left);
+        return;
+    }
+    if (ast->ctype->type == CTYPE_PTR)
+    {
+        emit_pointer_arithmetic_reg(ast);
+        return;
+    }
+    bool swapped;
+    char *opnd;
+    char *set = NULL;
+    switch (ast->type)
+    {
+    case '<':
+        set = "setl";
+        break;
+    case '>':
+        set = "setg";
+        break;
+    case PUNCT_EQ:
+        set = "sete";
+        break;
+    }
+    if (set)
+    {
+        opnd = emit_operands(ast->left, ast->right, 4, OPND_IMM | OPND_MEM, false, NULL);
+        emit("cmp %s, %%eax", opnd);
+        emit("%s %%al", set);
+        emit("movzbl %%al, %%eax");
+        return;
+    }
+    switch (ast->type)
+    {
+    case '+':
+        opnd = emit_operands(ast->left, ast->right, 4, OPND_IMM | OPND_MEM, true, &swapped);
+        emit("add %s, %%eax", opnd);
+        break;
+    case '-':
+        opnd = emit_operands(ast->left, ast->right, 4, OPND_IMM | OPND_MEM, false, NULL);
+        emit("sub %s, %%eax", opnd);
+        break;
+    case '*':
+        if (ast->left->type == AST_LITERAL || ast->right->type == AST_LITERAL)
+        {
+            Ast *lit = ast->right->type == AST_LITERAL ? ast->right : ast->left;
+            Ast *other = lit == ast->right ? ast->left : ast->right;
+            emit_expr(other);
+            if (!emit_mul_const("rax", 4, literal_value(lit)))
+                emit("imul $%d, %%eax", literal_value(lit));
+            break;
+        }
+        opnd = emit_operands(ast->left, ast->right, 4, OPND_IMM | OPND_MEM, true, &swapped);
+        emit("imul %s, %%eax", opnd);
+        break;
+    case '/':
+        if (ast->right->type == AST_LITERAL)
+        {
+            emit_expr(ast->left);
+            if (emit_div_const(literal_value(ast->right)))
+                break;
+            emit("mov $%d, %%ecx", literal_value(ast->right));
+            emit("cltd");
+            emit("idivl %%ecx");
+            break;
+        }
+        // 除数不能是立即数，被除数符号扩展到edx:eax
+        opnd = emit_operands(ast->left, ast->right, 4, OPND_MEM, false, NULL);
+        emit("cltd");
+        emit("idivl %s", opnd);
+        break;
+    default:
+        error("invalid operator '%d'", ast->type);
+    }
+}
+
 /**
  * 二元运算树代码产生
  */
 static void emit_binop(Ast *ast)
 {
+    if (flag_register_expr)
+    {
+        emit_binop_reg(ast);
+        return;
+    }
     // 如果是赋值语句
     if (ast->type == '=')
     {
@@ -345,26 +1456,201 @@ static void emit_binop(Ast *ast)
     default:
         error("invalid operator '%d'", ast->type);
     }
-    emit_expr(ast->left);
-    emit("push %%rax");
-    emit_expr(ast->right);
-    emit("mov %%rax, %%rbx");
-    emit("pop %%rax");
-    if (ast->type == '/')
+    emit_expr(ast->left);
+    emit("push %%rax");
+    emit_expr(ast->right);
+    emit("mov %%rax, %%rbx");
+    emit("pop %%rax");
+    if (ast->type == '/')
+    {
+        /* rdx存放余数 */
+        /* rax存放商 */
+        /* int 是32位的，被除数符号扩展到edx:eax，商再符号扩展到rax */
+        emit("cltd");
+        emit("idiv %%ebx");
+        emit("cltq");
+    }
+    else
+    {
+        emit("%s %%rbx, %%rax", op);
+    }
+}
+
+// 判断rax中表达式的值是否为0，-fregister-expr 模式下 int 只比较低32位
+static void emit_test(Ast *ast)
+{
+    if (flag_register_expr && opsize(ast->ctype) == 4)
+        emit("test %%eax, %%eax");
+    else
+        emit("test %%rax, %%rax");
+}
+
+/**
+ * @brief 条件为真(sense为true)或为假时跳转到 label
+ * -fcompare-branch 模式下比较运算直接生成 cmp 和 jcc，不把比较结果保存到rax中；! 只需要反转跳转条件
+ */
+static void emit_cond_jump(Ast *cond, bool sense, char *label)
+{
+    if (!flag_register_expr || !flag_compare_branch)
+    {
+        emit_expr(cond);
+        emit_test(cond);
+        emit("%s %s", sense ? "jne" : "je", label);
+        return;
+    }
+    char *jcc = NULL;
+    switch (cond->type)
+    {
+    case '!':
+        emit_cond_jump(cond->operand, !sense, label);
+        return;
+    case AST_LITERAL:
+        if ((literal_value(cond) != 0) == sense)
+            emit("jmp %s", label);
+        return;
+    case '<':
+        jcc = sense ? "jl" : "jge";
+        break;
+    case '>':
+        jcc = sense ? "jg" : "jle";
+        break;
+    case PUNCT_EQ:
+        jcc = sense ? "je" : "jne";
+        break;
+    }
+    if (jcc)
+    {
+        // 寄存器中的变量和字面量或变量比较时，不需要先加载到eax
+        char *lhs = simple_operand(cond->left, 4, 0);
+        char *rhs = simple_operand(cond->right, 4, OPND_IMM | OPND_MEM);
+        if (lhs && rhs)
+        {
+            emit("cmp %s, %s", rhs, lhs);
+            emit("%s %s", jcc, label);
+            return;
+        }
+        char *opnd = emit_operands(cond->left, cond->right, 4, OPND_IMM | OPND_MEM, false, NULL);
+        emit("cmp %s, %%eax", opnd);
+        emit("%s %s", jcc, label);
+        return;
+    }
+    emit_expr(cond);
+    emit_test(cond);
+    emit("%s %s", sense ? "jne" : "je", label);
+}
+
+/**
+ * @brief -fcall-args: 先计算所有参数，最后再放到参数寄存器中
+ * 参数寄存器在计算其它参数时不会被破坏，调用前后也就不需要保存；
+ * 函数入口已经把参数移到了栈上或者callee-saved寄存器中，调用时caller-saved寄存器中没有活跃的值
+ * 复杂的参数依次计算并暂存在临时寄存器中，最后一个直接从rax移过去，字面量和变量最后直接加载
+ */
+static void emit_call_args(Ast *ast)
+{
+    int nargs = vec_len(ast->args);
+    char *held[sizeof(REGS) / sizeof(*REGS)];
+    int last = -1;
+    for (int i = 0; i < nargs; i++)
+        if (!is_leaf(vec_get(ast->args, i)))
+            last = i;
+    for (int i = 0; i <= last; i++)
+    {
+        Ast *arg = vec_get(ast->args, i);
+        if (is_leaf(arg))
+            continue;
+        emit_expr(arg);
+        if (i == last)
+            emit("mov %%rax, %%%s", REGS[i]);
+        else
+            held[i] = hold_rax();
+    }
+    // 按照暂存的相反顺序取回
+    for (int i = last - 1; i >= 0; i--)
+    {
+        if (is_leaf(vec_get(ast->args, i)))
+            continue;
+        char *reg = unhold(held[i], REGS[i]);
+        if (reg != REGS[i])
+            emit("mov %%%s, %%%s", reg, REGS[i]);
+    }
+    for (int i = 0; i < nargs; i++)
+        if (is_leaf(vec_get(ast->args, i)))
+            emit_load_leaf(vec_get(ast->args, i), REGS[i]);
+}
+
+static void emit_funcall_reg(Ast *ast)
+{
+    emit_call_args(ast);
+    emit("mov $0, %%eax");
+    emit("call %s", ast->fname);
+}
+
+// ===================== tail call ====================
+
+/**
+ * -foptimize-sibling-calls 模式下，return f(...) 和函数体最后一条语句的调用是尾调用
+ * 参数放进参数寄存器之后，调用自己时把参数寄存器写回形参，跳回函数入口处；
+ * 调用其它函数时先恢复寄存器、释放栈帧，再 jmp 过去，由它直接返回到调用者
+ * 栈帧中的变量被取了地址时，它们可能被调用的函数通过指针访问，不做尾调用
+ */
+
+// 当前函数可以做尾调用时为当前函数，否则为NULL
+static Ast *tail_func;
+// 自身尾递归跳回的位置，在函数入口保存寄存器和参数之后
+static char *tail_label;
+
+static void emit_tail_call(Ast *ast)
+{
+    emit_call_args(ast);
+    if (!strcmp(ast->fname, tail_func->fname) && vec_len(ast->args) == vec_len(tail_func->params))
+    {
+        for (int i = 0; i < vec_len(tail_func->params); i++)
+            emit_param_reg(vec_get(tail_func->params, i), i);
+        emit("jmp %s", tail_label);
+        return;
+    }
+    emit_leave();
+    emit("mov $0, %%eax");
+    emit("jmp %s", ast->fname);
+}
+
+// -fregister-expr 模式下的 ++ 和 --，对内存中的值直接加减
+static void emit_incdec_reg(Ast *ast)
+{
+    char *inst = ast->type == PUNCT_INC ? "inc" : "dec";
+    Ast *var = ast->operand;
+    if (var->type == AST_DEREF)
     {
-        /* rdx存放余数 */
-        /* rax存放商 */
-        emit("mov $0, %%rdx");
-        emit("idiv %%rbx");
+        static char suffix[] = {[1] = 'b', [4] = 'l', [8] = 'q'};
+        char *mem = "(%rax)";
+        if (flag_scaled_index)
+            mem = emit_address(var->operand);
+        else
+            emit_expr(var->operand);
+        emit("%s%c %s", inst, suffix[ctype_size(var->ctype)], mem);
+        emit_load_deref(var->ctype, mem);
+        return;
     }
-    else
+    // 寄存器中的 int 和指针直接加减，char 需要截断，走下面的通用路径
+    if (var->type == AST_LVAR && var->lreg && var->ctype->type != CTYPE_CHAR)
     {
-        emit("%s %%rbx, %%rax", op);
+        int size = opsize(var->ctype);
+        emit("%s %%%s", inst, regname(var->lreg, size));
+        emit("mov %%%s, %%%s", regname(var->lreg, size), regname("rax", size));
+        return;
     }
+    emit_expr(var);
+    emit("%s %%%s", inst, regname("rax", opsize(var->ctype)));
+    emit_assign(var);
 }
 
 void emit_expr(Ast *ast)
 {
+    if (flag_register_expr && is_leaf(ast))
+    {
+        emit_load_leaf(ast, "rax");
+        return;
+    }
     switch (ast->type)
     {
     case AST_LITERAL:
@@ -391,37 +1677,50 @@ void emit_expr(Ast *ast)
         emit_gload(ast->ctype, ast->glabel);
         break;
     case AST_FUNCALL:
-        // 调用前 先将参数寄存器压栈，保存执行环境
-        for (int i = 0; i < list_len(ast->args); i++)
+        if (flag_register_expr && flag_call_args)
         {
-            emit("push %%%s", REGS[i]);
+            emit_funcall_reg(ast);
+            break;
         }
-        int j = 0;
-        for (Iter *i = list_iter(ast->args); !iter_end(i); j++)
+        /**
+         * 参数依次计算并压栈，全部计算完之后再弹出到参数寄存器中
+         * 计算后面的参数（比如除法和函数调用）不会破坏已经放好的参数寄存器
+         * 函数入口已经把参数保存到了栈上，调用前后不需要保存参数寄存器
+         */
+        for (int i = 0; i < vec_len(ast->args); i++)
         {
-            // 解析参数
-            emit_expr(iter_next(i));
-            emit("mov %%rax, %%%s", REGS[j]);
+            emit_expr(vec_get(ast->args, i));
+            emit("push %%rax");
         }
-        emit("mov $0, %%rax"); // 将rax初始化为0
-        emit("call %s", ast->fname);
-        // 调用后，恢复执行环境
-        for (int i = list_len(ast->args) - 1; i >= 0; i--)
-        {
+        for (int i = vec_len(ast->args) - 1; i >= 0; i--)
             emit("pop %%%s", REGS[i]);
-        }
+        if (flag_register_expr)
+            emit("mov $0, %%eax");
+        else
+            emit("mov $0, %%rax"); // 将rax初始化为0
+        emit("call %s", ast->fname);
         break;
     case AST_DECL:
         if(!ast->decl_init) return ;
-        
+        if(flag_bulk_init && ast->decl_var->ctype->type == CTYPE_ARRAY && emit_bulk_init(ast))
+            break;
+
         // array = {xxx, xxx, xxx}
         if (ast->decl_init->type == AST_ARRAY_INIT)
         {
-            int j = 0;
-            for (Iter *i = list_iter(ast->decl_init->array_init); !iter_end(i); j++)
+            Vector *init = ast->decl_init->array_init;
+            Ctype *elem = get_array_element_ctype(ast->decl_var->ctype);
+            for (int i = 0; i < vec_len(init); i++)
             {
-                emit_expr(iter_next(i));
-                emit_lsave(get_array_element_ctype(ast->decl_var->ctype), ast->decl_var->loff, -j);
+                emit_expr(vec_get(init, i));
+                emit_lsave(elem, ast->decl_var->loff, -i);
+            }
+            // 没有初始值的元素清零
+            int n = ctype_size(ast->decl_var->ctype) / ctype_size(elem);
+            for (int i = vec_len(init); i < n; i++)
+            {
+                emit("mov $0, %%rax");
+                emit_lsave(elem, ast->decl_var->loff, -i);
             }
         }
         // array = "xxxx"
@@ -430,31 +1729,47 @@ void emit_expr(Ast *ast)
             assert(ast->decl_init->type == AST_STRING);
             int i = 0;
             for (char *p = ast->decl_init->sval; *p; p++, i++)
-                emit("movb $%d, -%d(%%rbp)", *p, ast->decl_var->loff - i);
-            emit("movb $0, -%d(%%rbp)", ast->decl_var->loff - i);
+                emit("movb $%d, -%d(%%%s)", *p, ast->decl_var->loff - i, frame_reg);
+            for (; i < ctype_size(ast->decl_var->ctype); i++)
+                emit("movb $0, -%d(%%%s)", ast->decl_var->loff - i, frame_reg);
         }
         // char *a = "xxxx"
         else if (ast->decl_init->type == AST_STRING)
         {
             emit_gload(ast->decl_init->ctype, ast->decl_init->slabel);
-            emit_lsave(ast->decl_var->ctype, ast->decl_var->loff, 0);
+            emit_lvar_save(ast->decl_var);
         }
         // 其他declaration类型
         else
         {
             // 初始化值是变量表达式
             emit_expr(ast->decl_init);
-            emit_lsave(ast->decl_var->ctype, ast->decl_var->loff, 0);
+            emit_lvar_save(ast->decl_var);
         }
         break;
     case AST_ADDR:
         /* 保证操作数是变量类型 */
         assert(ast->operand->type == AST_LVAR);
         /* 将变量在栈中存放地址放入rax */
-        emit("lea -%d(%%rbp), %%rax", ast->operand->loff);
+        emit("lea -%d(%%%s), %%rax", ast->operand->loff, frame_reg);
         break;
     case AST_DEREF:
+        if (flag_register_expr && flag_scaled_index)
+        {
+            char *mem = emit_address(ast->operand);
+            if (ast->ctype->type == CTYPE_ARRAY)
+                emit_lea(mem);
+            else
+                emit_load_deref(ast->ctype, mem);
+            break;
+        }
         emit_expr(ast->operand);
+        if (flag_register_expr)
+        {
+            if (ast->operand->ctype->ptr->type != CTYPE_ARRAY)
+                emit_load_deref(ast->ctype, "(%rax)");
+            break;
+        }
         /* 访存，将值赋予rax */
         char *reg;
         switch (ctype_size(ast->ctype))
@@ -476,10 +1791,9 @@ void emit_expr(Ast *ast)
         }
         break;
     case AST_IF:
-        emit_expr(ast->cond);
+    {
         char *ne = make_next_label();
-        emit("test %%rax, %%rax");
-        emit("je %s", ne);
+        emit_cond_jump(ast->cond, false, ne);
         emit_expr(ast->then);
         if(ast->els){ // exist else clause
             char *end = make_next_label();
@@ -493,43 +1807,63 @@ void emit_expr(Ast *ast)
             emit_label("%s:", ne);
         }
         break;
+    }
     case AST_FOR:
         if(ast->forinit) emit_expr(ast->forinit);
         char *begin = make_next_label();
         char *end = make_next_label();
-        emit_label("%s:", begin);
-        if(ast->forcond){
-            emit_expr(ast->forcond);
-            emit("test %%rax, %%rax");
-            emit("je %s", end);
+        if(flag_rotate_loops){
+            // 循环旋转：入口处判断一次条件，之后在循环末尾判断，每次迭代只有一次跳转
+            if(ast->forcond) emit_cond_jump(ast->forcond, false, end);
+            emit_label("%s:", begin);
+            emit_expr(ast->forbody);
+            if(ast->forstep) emit_expr(ast->forstep);
+            if(ast->forcond) emit_cond_jump(ast->forcond, true, begin);
+            else emit("jmp %s", begin);
+            emit_label("%s:", end);
+            break;
         }
+        emit_label("%s:", begin);
+        if(ast->forcond) emit_cond_jump(ast->forcond, false, end);
         emit_expr(ast->forbody);
         if(ast->forstep) emit_expr(ast->forstep);
         emit("jmp %s", begin);
         emit_label("%s:", end);
         break;
     case AST_RET:
+        if (tail_func && ast->retval && ast->retval->type == AST_FUNCALL)
+        {
+            emit_tail_call(ast->retval);
+            break;
+        }
         emit_expr(ast->retval);
-        emit("leave"); // 恢复栈
-        emit("ret");
+        emit_ret();
         break;
     case AST_COMPOUND_STMT:
-        for(Iter *i = list_iter(ast->stmts);!iter_end(i); ){
-            emit_expr(iter_next(i));
+        for(int i = 0; i < vec_len(ast->stmts); i++){
+            emit_expr(vec_get(ast->stmts, i));
         }
         break;
     case PUNCT_DEC:
-        emit_expr(ast->operand);
-        emit("dec %%rax");
-        emit_assign(ast->operand);
-        break;
     case PUNCT_INC:
+        if (flag_register_expr)
+        {
+            emit_incdec_reg(ast);
+            break;
+        }
         emit_expr(ast->operand);
-        emit("inc %%rax");
+        emit("%s %%rax", ast->type == PUNCT_INC ? "inc" : "dec");
         emit_assign(ast->operand);
         break;
     case '!':
         emit_expr(ast->operand);
+        if (flag_register_expr)
+        {
+            emit_test(ast->operand);
+            emit("sete %%al");
+            emit("movzbl %%al, %%eax");
+            break;
+        }
         emit("cmp $0, %%rax");
         // sete将ZF的值拷贝到 指定寄存器中
         emit("sete %%al");
@@ -542,23 +1876,6 @@ void emit_expr(Ast *ast)
     }
 }
 
-static void emit_data_section()
-{
-    if (!globals)
-        return;
-    emit(".data");
-    for (Iter *i = list_iter(globals); !iter_end(i);)
-    {
-        Ast *p = iter_next(i);
-        emit_label("%s:", p->slabel);
-        if(p->type == AST_STRING){
-            emit(".string \"%s\"", quote(p->sval));
-        }
-        // 目前支持字符串全局变量，TODO 支持其他全局变量
-        else error("only string global data is available");
-    }
-}
-
 // >= n 的最小的8的倍数
 static int ceil8(int n)
 {
@@ -566,21 +1883,89 @@ static int ceil8(int n)
     return (rem == 0) ? n : n - rem + 8;
 }
 
-// 将字符串输出至rodata段，这里只考虑字符串，因为其他全局变量已经在toplevel中输出
-void emit_data_section_str(){
-    if(!globals) return;
-    bool flag = true;
-    for(Iter *i = list_iter(globals); !iter_end(i);){
-        Ast *v = iter_next(i);
-        if(v->type == AST_STRING){
-            if(flag){
-                emit(".section .rodata");
-                flag = false;
-            }
-            emit_label("%s:", v->slabel);
-            emit(".string \"%s\"", quote(v->sval));
+// 变量在栈上的对齐要求，数组按元素类型对齐
+static int ctype_align(Ctype *ctype)
+{
+    return ctype_size(get_array_element_ctype(ctype));
+}
+
+/**
+ * @brief 把局部变量放在栈帧中 off 之下，loff 是对齐要求的整数倍
+ * 提升到寄存器中的变量和已经分配过的变量不占空间
+ * @return 分配之后的栈帧大小
+ */
+static int place_var(Ast *var, int off)
+{
+    if (var->lreg || var->loff)
+        return off;
+    int align = ctype_align(var->ctype);
+    off += ctype_size(var->ctype);
+    off = (off + align - 1) / align * align;
+    var->loff = off;
+    return off;
+}
+
+/**
+ * @brief 按作用域分配局部变量，块中的变量只在块内存活
+ * 同一个块中的变量按对齐从大到小排列，减少填充
+ * 块结束之后它的空间可以给后面的兄弟块使用
+ * @param off 进入 ast 时已经使用的栈帧大小
+ * @return ast 中的变量需要的最大栈帧大小
+ */
+static int layout_locals(Ast *ast, int off)
+{
+    if (!ast)
+        return off;
+    switch (ast->type)
+    {
+    case AST_DECL:
+        return place_var(ast->decl_var, off);
+    case AST_COMPOUND_STMT:
+    {
+        // 插入排序，对齐相同的变量保持声明顺序
+        int ndecls = 0;
+        Ast **decls = qalloc(sizeof(Ast *) * (vec_len(ast->stmts) + 1));
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+        {
+            Ast *stmt = vec_get(ast->stmts, i);
+            if (stmt->type != AST_DECL)
+                continue;
+            Ast *var = stmt->decl_var;
+            int j = ndecls++;
+            for (; j > 0 && ctype_align(decls[j - 1]->ctype) < ctype_align(var->ctype); j--)
+                decls[j] = decls[j - 1];
+            decls[j] = var;
+        }
+        for (int i = 0; i < ndecls; i++)
+            off = place_var(decls[i], off);
+        int r = off;
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+        {
+            Ast *stmt = vec_get(ast->stmts, i);
+            if (stmt->type != AST_DECL)
+                r = max(r, layout_locals(stmt, off));
         }
-        else if(v->type != AST_GVAR) error("internal error: %s", ast_to_string(v));
+        return r;
+    }
+    case AST_IF:
+        return max(layout_locals(ast->then, off), layout_locals(ast->els, off));
+    case AST_FOR:
+        // for 的初始化部分定义的变量在整个循环中存活
+        off = layout_locals(ast->forinit, off);
+        return max(off, layout_locals(ast->forbody, off));
+    default:
+        return off;
+    }
+}
+
+// 将字符串输出至rodata段，所有函数输出之后统一调用
+void emit_data_section_str(){
+    if(!vec_len(strings)) return;
+    emit(".section .rodata");
+    for(int i = 0; i < vec_len(strings); i++){
+        Ast *v = vec_get(strings, i);
+        emit_label("%s:", v->slabel);
+        emit(".string \"%s\"", quote(v->sval));
     }
 }
 
@@ -603,8 +1988,9 @@ static void emit_data(Ast *ast){
     emit_label("%s:", ast->decl_var->glabel);
     // array = {xxx, xxx, xxx}
     if(ast->decl_init->type == AST_ARRAY_INIT){
-        for(Iter *i = list_iter(ast->decl_init->array_init); !iter_end(i); ){
-            emit_data_element_value(iter_next(i));
+        Vector *init = ast->decl_init->array_init;
+        for(int i = 0; i < vec_len(init); i++){
+            emit_data_element_value(vec_get(init, i));
         }
     }
     // array = "xxx"
@@ -632,40 +2018,407 @@ static void emit_global_var(Ast *ast){
     else emit_bss(ast);
 }
 
+/**
+ * @brief 统计局部变量的使用次数，循环中的使用按照循环深度加权
+ * 被取了地址的变量标记为-1
+ */
+static void count_var_uses(Ast *ast, int depth)
+{
+    if (!ast)
+        return;
+    switch (ast->type)
+    {
+    case AST_LVAR:
+        if (ast->luses >= 0)
+            ast->luses += 1 << (3 * (depth < 3 ? depth : 3));
+        return;
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_GVAR:
+        return;
+    case AST_ADDR:
+        if (ast->operand->type == AST_LVAR)
+        {
+            ast->operand->luses = -1;
+            return;
+        }
+        count_var_uses(ast->operand, depth);
+        return;
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        count_var_uses(ast->operand, depth);
+        return;
+    case AST_FUNCALL:
+        for (int i = 0; i < vec_len(ast->args); i++)
+            count_var_uses(vec_get(ast->args, i), depth);
+        return;
+    case AST_DECL:
+        count_var_uses(ast->decl_var, depth);
+        if (ast->decl_init && ast->decl_init->type == AST_ARRAY_INIT)
+            for (int i = 0; i < vec_len(ast->decl_init->array_init); i++)
+                count_var_uses(vec_get(ast->decl_init->array_init, i), depth);
+        else
+            count_var_uses(ast->decl_init, depth);
+        return;
+    case AST_IF:
+        count_var_uses(ast->cond, depth);
+        count_var_uses(ast->then, depth);
+        count_var_uses(ast->els, depth);
+        return;
+    case AST_FOR:
+        count_var_uses(ast->forinit, depth);
+        count_var_uses(ast->forcond, depth + 1);
+        count_var_uses(ast->forstep, depth + 1);
+        count_var_uses(ast->forbody, depth + 1);
+        return;
+    case AST_RET:
+        count_var_uses(ast->retval, depth);
+        return;
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            count_var_uses(vec_get(ast->stmts, i), depth);
+        return;
+    default:
+        count_var_uses(ast->left, depth);
+        count_var_uses(ast->right, depth);
+    }
+}
+
+// 可以提升到寄存器中的变量：标量，并且没有被取地址
+static bool promotable(Ast *var)
+{
+    return var->ctype->type != CTYPE_ARRAY && var->luses > 0;
+}
+
+static void add_candidate(Vector *cands, Ast *var)
+{
+    var->lreg = NULL;
+    if (!promotable(var))
+        return;
+    vec_push(cands, var);
+    // 按照使用次数从大到小插入排序
+    for (int i = vec_len(cands) - 1; i > 0; i--)
+    {
+        Ast *a = cands->body[i - 1], *b = cands->body[i];
+        if (a->luses >= b->luses)
+            break;
+        cands->body[i - 1] = b;
+        cands->body[i] = a;
+    }
+}
+
+// 函数体中有没有函数调用
+static bool has_call(Ast *ast)
+{
+    if (!ast)
+        return false;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return false;
+    case AST_FUNCALL:
+        return true;
+    case AST_ADDR:
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        return has_call(ast->operand);
+    case AST_DECL:
+        if (ast->decl_init && ast->decl_init->type == AST_ARRAY_INIT)
+        {
+            for (int i = 0; i < vec_len(ast->decl_init->array_init); i++)
+                if (has_call(vec_get(ast->decl_init->array_init, i)))
+                    return true;
+            return false;
+        }
+        return has_call(ast->decl_init);
+    case AST_IF:
+        return has_call(ast->cond) || has_call(ast->then) || has_call(ast->els);
+    case AST_FOR:
+        return has_call(ast->forinit) || has_call(ast->forcond) ||
+               has_call(ast->forstep) || has_call(ast->forbody);
+    case AST_RET:
+        return has_call(ast->retval);
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            if (has_call(vec_get(ast->stmts, i)))
+                return true;
+        return false;
+    default:
+        return has_call(ast->left) || has_call(ast->right);
+    }
+}
+
+// 有没有对局部变量取地址
+static bool takes_address(Ast *ast)
+{
+    if (!ast)
+        return false;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return false;
+    case AST_ADDR:
+        return true;
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        return takes_address(ast->operand);
+    case AST_FUNCALL:
+        for (int i = 0; i < vec_len(ast->args); i++)
+            if (takes_address(vec_get(ast->args, i)))
+                return true;
+        return false;
+    case AST_DECL:
+        if (ast->decl_init && ast->decl_init->type == AST_ARRAY_INIT)
+        {
+            for (int i = 0; i < vec_len(ast->decl_init->array_init); i++)
+                if (takes_address(vec_get(ast->decl_init->array_init, i)))
+                    return true;
+            return false;
+        }
+        return takes_address(ast->decl_init);
+    case AST_IF:
+        return takes_address(ast->cond) || takes_address(ast->then) || takes_address(ast->els);
+    case AST_FOR:
+        return takes_address(ast->forinit) || takes_address(ast->forcond) ||
+               takes_address(ast->forstep) || takes_address(ast->forbody);
+    case AST_RET:
+        return takes_address(ast->retval);
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            if (takes_address(vec_get(ast->stmts, i)))
+                return true;
+        return false;
+    default:
+        return takes_address(ast->left) || takes_address(ast->right);
+    }
+}
+
+// 栈帧中的变量的地址可能被调用的函数使用：取了地址的变量，或者数组
+static bool frame_escapes(Ast *func)
+{
+    for (int i = 0; i < vec_len(func->locals); i++)
+        if (((Ast *)vec_get(func->locals, i))->ctype->type == CTYPE_ARRAY)
+            return true;
+    return takes_address(func->body);
+}
+
+// 语句中有没有 return 调用自己
+static bool has_self_tail_call(Ast *ast, Ast *func)
+{
+    if (!ast)
+        return false;
+    switch (ast->type)
+    {
+    case AST_RET:
+        return ast->retval && ast->retval->type == AST_FUNCALL && !strcmp(ast->retval->fname, func->fname);
+    case AST_IF:
+        return has_self_tail_call(ast->then, func) || has_self_tail_call(ast->els, func);
+    case AST_FOR:
+        return has_self_tail_call(ast->forbody, func);
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            if (has_self_tail_call(vec_get(ast->stmts, i), func))
+                return true;
+        return false;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief 确定当前函数能不能做尾调用
+ * 函数体最后一条语句的值就是返回值，它是调用时改写成 return
+ */
+static void setup_tail_calls(Ast *func)
+{
+    tail_func = NULL;
+    tail_label = NULL;
+    if (!flag_register_expr || !flag_call_args || !flag_sibling_calls || frame_escapes(func))
+        return;
+    tail_func = func;
+    Vector *stmts = func->body->stmts;
+    Ast *last = vec_len(stmts) ? vec_get(stmts, vec_len(stmts) - 1) : NULL;
+    if (last && last->type == AST_FUNCALL)
+    {
+        Ast *r = qalloc(sizeof(Ast));
+        r->type = AST_RET;
+        r->ctype = NULL;
+        r->retval = last;
+        stmts->body[vec_len(stmts) - 1] = r;
+    }
+    if (has_self_tail_call(func->body, func))
+        tail_label = make_next_label();
+}
+
+// 叶子函数的参数可以留在参数寄存器中，rdx 和 rcx 会被除法和表达式求值用到
+static bool stays_in_arg_reg(int i)
+{
+    return i == 0 || i == 1 || i == 4 || i == 5;
+}
+
+/**
+ * @brief 分配函数使用的callee-saved寄存器
+ * 表达式求值最多预留2个临时寄存器，剩下的按照使用次数分给局部变量和参数
+ * -fomit-leaf-frame 模式下，叶子函数的参数尽量直接留在参数寄存器中
+ */
+static void alloc_func_regs(Ast *func, bool leaf)
+{
+    int want = need(func->body) - 1;
+    if (want > NSCRATCH)
+        want = NSCRATCH;
+    int npromoted = 0;
+    Vector *cands = make_vector();
+    if (flag_promote_regs)
+    {
+        count_var_uses(func->body, 0);
+        for (int i = 0; i < vec_len(func->params); i++)
+        {
+            Ast *p = vec_get(func->params, i);
+            if (leaf && stays_in_arg_reg(i) && promotable(p))
+            {
+                p->lreg = REGS[i];
+                continue;
+            }
+            add_candidate(cands, p);
+        }
+        for (int i = 0; i < vec_len(func->locals); i++)
+            add_candidate(cands, vec_get(func->locals, i));
+        npromoted = vec_len(cands);
+        int limit = NSCRATCH - (want < 2 ? want : 2);
+        if (npromoted > limit)
+            npromoted = limit;
+    }
+    nscratch = want < NSCRATCH - npromoted ? want : NSCRATCH - npromoted;
+    used_scratch = 0;
+    nsaved = nscratch + npromoted;
+    for (int i = 0; i < npromoted; i++)
+        ((Ast *)vec_get(cands, i))->lreg = SCRATCH[nscratch + i];
+}
+
 /**
  * @brief initialize the runtime of a function
  * such as .text function name 
  * pre-alloc stack memeory for parameters and locals varaibles in the function
  */
 static void emit_func_runtime(Ast *func){
-    if(list_len(func->params) > sizeof(REGS) / sizeof(*REGS))
+    if(vec_len(func->params) > sizeof(REGS) / sizeof(*REGS))
         error("Parameter list is too long: %s", func->fname);
     emit(".text");
     emit(".global %s", func->fname);
     emit_label("%s:", func->fname);
-    emit("push %%rbp");
-    emit("mov %%rsp, %%rbp");
-    // 下面计算函数所需要的栈空间，参数 + 局部变量
-    // 首先是 parameters 
+    // 先计算函数所需要的栈空间：保存的寄存器 + 参数 + 局部变量
+    bool leaf = flag_register_expr && flag_omit_leaf_frame && !has_call(func->body);
     int off = 0;
-    int idx = 0;
-    for(Iter *i = list_iter(func->params); !iter_end(i); idx++){
-        emit("push %%%s", REGS[idx]); // 将寄存器中保存的实参压栈
-        Ast *p = iter_next(i);
-        off += ceil8(ctype_size(p->ctype)); // 该形参的off 恰好指向已经压栈的实参的起始地址
+    if(flag_register_expr){
+        // 保存函数中用到的寄存器，它们位于栈帧的最上方
+        alloc_func_regs(func, leaf);
+        off = nsaved * 8;
+    }
+    // 首先是 parameters，该形参的off 恰好指向已经压栈的实参的起始地址
+    for(int i = 0; i < vec_len(func->params); i++){
+        Ast *p = vec_get(func->params, i);
+        if(p->lreg) continue;
+        off += ceil8(ctype_size(p->ctype));
         p->loff = off;
     }
     // 然后是函数内部定义的局部变量
-    for(Iter *i = list_iter(func->locals); !iter_end(i);){
-        Ast *var = iter_next(i);
+    if(flag_pack_frame){
+        // 循环展开之后同一个变量可能出现在多个声明中，只分配一次
+        for(int i = 0; i < vec_len(func->locals); i++)
+            ((Ast *)vec_get(func->locals, i))->loff = 0;
+        off = layout_locals(func->body, off);
+        // 不在任何声明中的变量，比如外提的不变表达式，在整个函数中存活
+        for(int i = 0; i < vec_len(func->locals); i++)
+            off = place_var(vec_get(func->locals, i), off);
+        off = ceil8(off);
+    }
+    for(int i = 0; i < vec_len(func->locals) && !flag_pack_frame; i++){
+        Ast *var = vec_get(func->locals, i);
+        if(var->lreg) continue;
         off += ceil8(ctype_size(var->ctype));
         var->loff = off;
     }
+    /**
+     * 不调用其它函数、求值时也不需要压栈的叶子函数不建立栈帧
+     * rsp 在函数中保持不变，整个栈帧都在rsp下方128字节的red zone中，相对rsp寻址
+     */
+    frameless = leaf && need(func->body) - 1 - nscratch <= RED_ZONE_SPILLS &&
+                off + RED_ZONE_SPILLS * 8 <= 128;
+    frame_reg = frameless ? "rsp" : "rbp";
+    frame_size = off;
+    spill_depth = 0;
+    if(!frameless){
+        emit("push %%rbp");
+        emit("mov %%rsp, %%rbp");
+    }
+    for(int i = 0; i < nsaved; i++){
+        if(frameless)
+            emit("mov %%%s, -%d(%%rsp)", SCRATCH[i], (i + 1) * 8);
+        else
+            emit("push %%%s", SCRATCH[i]);
+    }
+    int pushed = nsaved * 8;
+    for(int i = 0; i < vec_len(func->params); i++){
+        Ast *p = vec_get(func->params, i);
+        if(p->lreg || frameless){
+            emit_param_reg(p, i);
+            continue;
+        }
+        emit("push %%%s", REGS[i]); // 将寄存器中保存的实参压栈
+        pushed += 8;
+    }
+    if(frameless)
+        return;
+    if(flag_register_expr){
+        // 已经压栈的部分不需要再分配，并且保证栈帧大小是16的倍数
+        int size = (off + 15) & ~15;
+        if(size > pushed) emit("sub $%d, %%rsp", size - pushed);
+        return;
+    }
     if(off) emit("sub $%d, %%rsp", off);
 }
 
-static void emit_func_end(){
-    emit("leave");
+/**
+ * @brief 把第i个参数寄存器中的实参保存到形参中
+ * 已经在栈上分配好位置的形参直接写入，不用压栈
+ */
+static void emit_param_reg(Ast *p, int i){
+    if(!p->lreg){
+        emit("mov %%%s, -%d(%%%s)", REGS[i], p->loff, frame_reg);
+        return;
+    }
+    // 提升到寄存器中的参数直接从参数寄存器拷贝过去
+    // 留在参数寄存器中的 int 和 char 也要清零高位
+    if(p->ctype->type == CTYPE_CHAR)
+        emit("movzbl %%%s, %%%s", regname(REGS[i], 1), regname(p->lreg, 4));
+    else if(p->lreg != REGS[i] || opsize(p->ctype) == 4)
+        emit("mov %%%s, %%%s", regname(REGS[i], opsize(p->ctype)), regname(p->lreg, opsize(p->ctype)));
+}
+
+// 恢复寄存器并释放栈帧
+static void emit_leave(void){
+    // 恢复函数入口处保存的临时寄存器
+    if(flag_register_expr)
+        for(int i = 0; i < nsaved; i++)
+            emit("mov -%d(%%%s), %%%s", (i + 1) * 8, frame_reg, SCRATCH[i]);
+    if(!frameless)
+        emit("leave"); // 恢复栈
+}
+
+static void emit_ret(void){
+    emit_leave();
     emit("ret");
 }
 
@@ -674,9 +2427,18 @@ static void emit_func_end(){
  */
 void emit_toplevel(Ast *ast){
     if(ast->type == AST_FUNCDEF){
+        optimize_func(ast);
+        if(emit_ir(ast))
+            return;
+        init_data = make_vector();
+        init_labels = make_vector();
+        setup_tail_calls(ast);
         emit_func_runtime(ast);
+        if(tail_label)
+            emit_label("%s:", tail_label);
         emit_expr(ast->body);
-        emit_func_end();
+        emit_ret();
+        emit_init_data();
     }
     else if(ast->type == AST_DECL){
         emit_global_var(ast);
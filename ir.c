@@ -0,0 +1,1176 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 15:20:36
+ * @LastEditTime: 2026-10-17 15:20:36
+ * @LastEditors: QQYYHH
+ * @Description: SSA intermediate representation
+ * @FilePath: /pwn/qcc/ir.c
+ * welcome to my github: https://github.com/QQYYHH
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "qcc.h"
+
+/**
+ * 三地址码形式的中间表示，函数由基本块组成，每条指令的结果都是一个SSA值
+ * 没有被取地址的标量局部变量直接用SSA值表示，在构造的过程中插入phi
+ * 数组、被取了地址的变量和全局变量通过 load/store 访问内存
+ *
+ * SSA的构造采用 Braun 等人的算法（Simple and Efficient Construction of SSA Form）
+ * 一边把抽象语法树翻译成指令，一边记录每个基本块中变量的当前定义
+ */
+
+#define emit(...)        emitf(__LINE__, "\t" __VA_ARGS__)
+#define emit_label(...)  emitf(__LINE__, __VA_ARGS__)
+
+extern void emitf(int line, char *fmt, ...);
+
+enum
+{
+    IR_CONST,
+    IR_PARAM,  // 第ival个参数
+    IR_LADDR,  // 局部变量的地址
+    IR_GADDR,  // 全局变量或字符串的地址
+    IR_LOAD,   // 从地址a加载size个字节，零扩展
+    IR_STORE,  // 将b的低size个字节保存到地址a
+    IR_ADD,
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_SAR,    // 算术右移ival位
+    IR_LT,
+    IR_GT,
+    IR_EQ,
+    IR_NOT,
+    IR_SEXT,   // 32位整数符号扩展到64位
+    IR_ZEXT8,  // 截断为8位后零扩展
+    IR_CALL,
+    IR_PHI,
+    IR_JMP,
+    IR_BR,     // a不为0时跳转到then，否则跳转到els
+    IR_RET,
+};
+
+static char *IR_NAMES[] = {
+    "const", "param", "laddr", "gaddr", "load", "store",
+    "add", "sub", "mul", "div", "sar", "lt", "gt", "eq", "not", "sext", "zext8",
+    "call", "phi", "jmp", "br", "ret",
+};
+
+typedef struct Block Block;
+
+typedef struct Inst
+{
+    int op;
+    // SSA值的编号
+    int id;
+    // 结果的宽度，int 和 char 是4，指针是8；load/store 表示访问内存的字节数
+    int size;
+    struct Inst *a, *b;
+    // call 的实参，phi 的操作数（与前驱基本块一一对应）
+    Vector *args;
+    int ival;
+    // gaddr 的标签，call 的函数名
+    char *label;
+    // laddr 的局部变量，phi 对应的变量
+    Ast *var;
+    // phi 所在的基本块
+    Block *block;
+    // jmp 和 br 的跳转目标
+    Block *then, *els;
+    // 平凡的phi被消除之后，指向替代它的值
+    struct Inst *forward;
+    int uses;
+    // 栈上保存这个值的位置，phi 另外有一个入口位置
+    int off;
+    int inoff;
+} Inst;
+
+struct Block
+{
+    int id;
+    char *label;
+    Vector *phis;
+    Vector *insts;
+    Vector *preds;
+    // 所有前驱都已经确定
+    bool sealed;
+    // 未封闭时读取变量产生的phi，封闭时再补全操作数
+    Vector *incomplete;
+    // 变量在这个基本块中的当前定义，按变量编号索引
+    Inst **defs;
+};
+
+// 当前函数
+static Vector *blocks;
+static Block *cur;
+static int nvalues;
+// SSA变量，0号是函数的“返回值”，即最后一个表达式语句的值
+static Vector *ssa_vars;
+// 需要栈空间的局部变量
+static Vector *mem_vars;
+
+static Inst *lower_expr(Ast *ast);
+static void lower_stmt(Ast *ast);
+
+// ===================== construction ====================
+
+static Block *new_block(void)
+{
+    Block *b = qalloc(sizeof(Block));
+    memset(b, 0, sizeof(Block));
+    b->id = vec_len(blocks);
+    b->label = make_next_label();
+    b->phis = make_vector();
+    b->insts = make_vector();
+    b->preds = make_vector();
+    b->incomplete = make_vector();
+    vec_push(blocks, b);
+    return b;
+}
+
+static Inst *make_inst(int op, int size)
+{
+    Inst *v = qalloc(sizeof(Inst));
+    memset(v, 0, sizeof(Inst));
+    v->op = op;
+    v->size = size;
+    v->id = nvalues++;
+    return v;
+}
+
+// 在当前基本块末尾添加指令
+static Inst *new_inst(int op, int size, Inst *a, Inst *b)
+{
+    Inst *v = make_inst(op, size);
+    v->a = a;
+    v->b = b;
+    vec_push(cur->insts, v);
+    return v;
+}
+
+// 常量不属于任何基本块，使用时直接作为立即数
+static Inst *new_const(int val)
+{
+    Inst *v = make_inst(IR_CONST, 4);
+    v->ival = val;
+    return v;
+}
+
+static bool is_terminated(Block *b)
+{
+    if (!vec_len(b->insts))
+        return false;
+    int op = ((Inst *)vec_get(b->insts, vec_len(b->insts) - 1))->op;
+    return op == IR_JMP || op == IR_BR || op == IR_RET;
+}
+
+static void add_edge(Block *from, Block *to)
+{
+    vec_push(to->preds, from);
+}
+
+static void emit_jmp(Block *to)
+{
+    if (is_terminated(cur))
+        return;
+    Inst *v = new_inst(IR_JMP, 0, NULL, NULL);
+    v->then = to;
+    add_edge(cur, to);
+}
+
+static void emit_br(Inst *cond, Block *then, Block *els)
+{
+    Inst *v = new_inst(IR_BR, 0, cond, NULL);
+    v->then = then;
+    v->els = els;
+    add_edge(cur, then);
+    add_edge(cur, els);
+}
+
+static Inst *resolve(Inst *v)
+{
+    while (v && v->forward)
+        v = v->forward;
+    return v;
+}
+
+static void write_var(Block *b, int idx, Inst *v)
+{
+    if (!b->defs)
+    {
+        b->defs = qalloc(vec_len(ssa_vars) * sizeof(Inst *));
+        memset(b->defs, 0, vec_len(ssa_vars) * sizeof(Inst *));
+    }
+    b->defs[idx] = v;
+}
+
+static Inst *read_var(Block *b, int idx);
+
+static int var_size(int idx)
+{
+    Ast *var = vec_get(ssa_vars, idx);
+    return var && var->ctype->type != CTYPE_PTR ? 4 : 8;
+}
+
+static Inst *new_phi(Block *b, int idx)
+{
+    Inst *v = make_inst(IR_PHI, var_size(idx));
+    v->ival = idx;
+    v->var = vec_get(ssa_vars, idx);
+    v->block = b;
+    v->args = make_vector();
+    vec_push(b->phis, v);
+    return v;
+}
+
+// 如果phi的操作数除了自己之外只有一个值，就用这个值代替它
+static Inst *try_remove_trivial_phi(Inst *phi)
+{
+    Inst *same = NULL;
+    for (int i = 0; i < vec_len(phi->args); i++)
+    {
+        Inst *op = resolve(vec_get(phi->args, i));
+        if (op == same || op == phi)
+            continue;
+        if (same)
+            return phi;
+        same = op;
+    }
+    if (!same)
+        same = new_const(0);
+    phi->forward = same;
+    return same;
+}
+
+static void add_phi_operands(Inst *phi)
+{
+    Block *b = phi->block;
+    for (int i = 0; i < vec_len(b->preds); i++)
+        vec_push(phi->args, read_var(vec_get(b->preds, i), phi->ival));
+}
+
+static Inst *read_var_recursive(Block *b, int idx)
+{
+    Inst *v;
+    if (!b->sealed)
+    {
+        v = new_phi(b, idx);
+        vec_push(b->incomplete, v);
+    }
+    else if (vec_len(b->preds) == 0)
+    {
+        // 未初始化的变量
+        v = new_const(0);
+    }
+    else if (vec_len(b->preds) == 1)
+    {
+        v = read_var(vec_get(b->preds, 0), idx);
+    }
+    else
+    {
+        // 先写入phi，打破循环中的递归
+        v = new_phi(b, idx);
+        write_var(b, idx, v);
+        add_phi_operands(v);
+        v = try_remove_trivial_phi(v);
+    }
+    write_var(b, idx, v);
+    return v;
+}
+
+static Inst *read_var(Block *b, int idx)
+{
+    if (b->defs && b->defs[idx])
+        return resolve(b->defs[idx]);
+    return read_var_recursive(b, idx);
+}
+
+// 基本块的所有前驱都已经确定，补全未完成的phi
+static void seal_block(Block *b)
+{
+    b->sealed = true;
+    for (int i = 0; i < vec_len(b->incomplete); i++)
+    {
+        Inst *phi = vec_get(b->incomplete, i);
+        add_phi_operands(phi);
+        try_remove_trivial_phi(phi);
+    }
+}
+
+// ===================== lowering Ast ====================
+
+static int ir_size(Ctype *ctype)
+{
+    return (ctype->type == CTYPE_PTR || ctype->type == CTYPE_ARRAY) ? 8 : 4;
+}
+
+// 用SSA值表示的局部变量的编号，-1表示变量在栈上
+static int ssa_index(Ast *var)
+{
+    return var->type == AST_LVAR && var->lid >= 0 ? var->lid : -1;
+}
+
+static Inst *fold(int op, Inst *a, Inst *b)
+{
+    int x = a->ival, y = b->ival;
+    switch (op)
+    {
+    case IR_ADD:
+        return new_const(x + y);
+    case IR_SUB:
+        return new_const(x - y);
+    case IR_MUL:
+        return new_const(x * y);
+    case IR_DIV:
+        return y ? new_const(x / y) : NULL;
+    case IR_LT:
+        return new_const(x < y);
+    case IR_GT:
+        return new_const(x > y);
+    case IR_EQ:
+        return new_const(x == y);
+    }
+    return NULL;
+}
+
+// 二元运算，两个操作数都是常量时直接折叠
+static Inst *new_binop(int op, int size, Inst *a, Inst *b)
+{
+    if (size == 4 && a->op == IR_CONST && b->op == IR_CONST)
+    {
+        Inst *r = fold(op, a, b);
+        if (r)
+            return r;
+    }
+    return new_inst(op, size, a, b);
+}
+
+static Inst *new_addr(Ast *var)
+{
+    if (var->type == AST_GVAR)
+    {
+        Inst *v = new_inst(IR_GADDR, 8, NULL, NULL);
+        v->label = var->glabel;
+        return v;
+    }
+    Inst *v = new_inst(IR_LADDR, 8, NULL, NULL);
+    v->var = var;
+    return v;
+}
+
+static Inst *new_load(Ctype *ctype, Inst *addr)
+{
+    if (ctype->type == CTYPE_ARRAY)
+        return addr;
+    return new_inst(IR_LOAD, ctype_size(ctype), addr, NULL);
+}
+
+static void new_store(Ctype *ctype, Inst *addr, Inst *val)
+{
+    new_inst(IR_STORE, ctype_size(ctype), addr, val);
+}
+
+// 左值的地址，SSA变量没有地址
+static Inst *lower_addr(Ast *ast)
+{
+    switch (ast->type)
+    {
+    case AST_LVAR:
+    case AST_GVAR:
+        return new_addr(ast);
+    case AST_DEREF:
+        return lower_expr(ast->operand);
+    default:
+        error("lvalue expected, but got %s", ast_to_string(ast));
+    }
+}
+
+// 给变量赋值，返回赋值表达式的值
+static Inst *lower_assign(Ast *var, Inst *val)
+{
+    int idx = ssa_index(var);
+    if (idx >= 0)
+    {
+        Inst *v = val;
+        if (var->ctype->type == CTYPE_CHAR)
+            v = val->op == IR_CONST ? new_const((unsigned char)val->ival) : new_inst(IR_ZEXT8, 4, val, NULL);
+        write_var(cur, idx, v);
+        return val;
+    }
+    new_store(var->ctype, lower_addr(var), val);
+    return val;
+}
+
+static Inst *lower_pointer_arithmetic(Ast *ast)
+{
+    Inst *a = lower_expr(ast->left);
+    Inst *b = lower_expr(ast->right);
+    int op = ast->type == '+' ? IR_ADD : IR_SUB;
+    if (ast->right->ctype->type == CTYPE_PTR)
+    {
+        if (ast->type == '+')
+            error("No meaning for ptr plus ptr");
+        Inst *diff = new_inst(IR_SUB, 8, a, b);
+        Inst *r = new_inst(IR_SAR, 8, diff, NULL);
+        int sz = ctype_size(ast->left->ctype->ptr);
+        r->ival = sz == 1 ? 0 : sz == 4 ? 2 : 3;
+        return r;
+    }
+    int sz = ctype_size(ast->left->ctype->ptr);
+    if (b->op == IR_CONST)
+        return new_inst(op, 8, a, new_const(b->ival * sz));
+    Inst *idx = new_inst(IR_SEXT, 8, b, NULL);
+    if (sz > 1)
+        idx = new_inst(IR_MUL, 8, idx, new_const(sz));
+    return new_inst(op, 8, a, idx);
+}
+
+static Inst *lower_binop(Ast *ast)
+{
+    if (ast->type == '=')
+        return lower_assign(ast->left, lower_expr(ast->right));
+    if (ast->ctype->type == CTYPE_PTR)
+        return lower_pointer_arithmetic(ast);
+    int op;
+    switch (ast->type)
+    {
+    case '+': op = IR_ADD; break;
+    case '-': op = IR_SUB; break;
+    case '*': op = IR_MUL; break;
+    case '/': op = IR_DIV; break;
+    case '<': op = IR_LT; break;
+    case '>': op = IR_GT; break;
+    case PUNCT_EQ: op = IR_EQ; break;
+    default:
+        error("invalid operator '%d'", ast->type);
+    }
+    Inst *a = lower_expr(ast->left);
+    Inst *b = lower_expr(ast->right);
+    return new_binop(op, 4, a, b);
+}
+
+static Inst *lower_incdec(Ast *ast)
+{
+    Ast *var = ast->operand;
+    int op = ast->type == PUNCT_INC ? IR_ADD : IR_SUB;
+    int size = ir_size(var->ctype);
+    if (ssa_index(var) >= 0)
+    {
+        Inst *v = new_binop(op, size, lower_expr(var), new_const(1));
+        return lower_assign(var, v);
+    }
+    Inst *addr = lower_addr(var);
+    Inst *v = new_binop(op, size, new_load(var->ctype, addr), new_const(1));
+    new_store(var->ctype, addr, v);
+    if (var->ctype->type == CTYPE_CHAR)
+        return new_inst(IR_ZEXT8, 4, v, NULL);
+    return v;
+}
+
+static Inst *lower_expr(Ast *ast)
+{
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+        return new_const(ast->ctype->type == CTYPE_CHAR ? (unsigned char)ast->c : ast->ival);
+    case AST_STRING:
+    {
+        Inst *v = new_inst(IR_GADDR, 8, NULL, NULL);
+        v->label = ast->slabel;
+        return v;
+    }
+    case AST_LVAR:
+    {
+        int idx = ssa_index(ast);
+        if (idx >= 0)
+            return read_var(cur, idx);
+        return new_load(ast->ctype, new_addr(ast));
+    }
+    case AST_GVAR:
+        return new_load(ast->ctype, new_addr(ast));
+    case AST_ADDR:
+        return lower_addr(ast->operand);
+    case AST_DEREF:
+    {
+        Inst *addr = lower_expr(ast->operand);
+        if (ast->operand->ctype->ptr->type == CTYPE_ARRAY)
+            return addr;
+        return new_load(ast->ctype, addr);
+    }
+    case AST_FUNCALL:
+    {
+        Vector *args = make_vector();
+        for (int i = 0; i < vec_len(ast->args); i++)
+            vec_push(args, lower_expr(vec_get(ast->args, i)));
+        Inst *v = new_inst(IR_CALL, 8, NULL, NULL);
+        v->label = ast->fname;
+        v->args = args;
+        return v;
+    }
+    case '!':
+    {
+        Inst *v = lower_expr(ast->operand);
+        if (v->op == IR_CONST)
+            return new_const(!v->ival);
+        return new_inst(IR_NOT, ir_size(ast->operand->ctype), v, NULL);
+    }
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        return lower_incdec(ast);
+    default:
+        return lower_binop(ast);
+    }
+}
+
+// 记录最后一个表达式的值，函数没有return时返回它
+static void set_result(Inst *v)
+{
+    write_var(cur, 0, v);
+}
+
+static void lower_decl(Ast *ast)
+{
+    Ast *var = ast->decl_var;
+    Ast *init = ast->decl_init;
+    if (!init)
+        return;
+    if (init->type == AST_ARRAY_INIT)
+    {
+        Ctype *elem = var->ctype;
+        while (elem->type == CTYPE_ARRAY)
+            elem = elem->ptr;
+        int sz = ctype_size(elem);
+        for (int i = 0; i < vec_len(init->array_init); i++)
+        {
+            Inst *v = lower_expr(vec_get(init->array_init, i));
+            Inst *addr = new_inst(IR_ADD, 8, new_addr(var), new_const(i * sz));
+            new_store(elem, addr, v);
+            set_result(v);
+        }
+        // 没有初始值的元素清零
+        for (int i = vec_len(init->array_init); i < ctype_size(var->ctype) / sz; i++)
+        {
+            Inst *addr = new_inst(IR_ADD, 8, new_addr(var), new_const(i * sz));
+            new_store(elem, addr, new_const(0));
+        }
+        return;
+    }
+    if (var->ctype->type == CTYPE_ARRAY)
+    {
+        // char s[] = "..."
+        // 字符串之后的部分清零
+        char *p = init->sval;
+        int len = strlen(p);
+        for (int i = 0; i < ctype_size(var->ctype); i++)
+        {
+            Inst *addr = new_inst(IR_ADD, 8, new_addr(var), new_const(i));
+            new_store(ctype_char, addr, new_const(i < len ? (unsigned char)p[i] : 0));
+        }
+        return;
+    }
+    set_result(lower_assign(var, lower_expr(init)));
+}
+
+static void lower_stmt(Ast *ast)
+{
+    switch (ast->type)
+    {
+    case AST_DECL:
+        lower_decl(ast);
+        return;
+    case AST_IF:
+    {
+        Inst *cond = lower_expr(ast->cond);
+        set_result(cond);
+        Block *then = new_block(), *els = new_block(), *end = ast->els ? new_block() : els;
+        emit_br(cond, then, els);
+        seal_block(then);
+        seal_block(els);
+        cur = then;
+        lower_stmt(ast->then);
+        emit_jmp(end);
+        if (ast->els)
+        {
+            cur = els;
+            lower_stmt(ast->els);
+            emit_jmp(end);
+            seal_block(end);
+        }
+        cur = end;
+        return;
+    }
+    case AST_FOR:
+    {
+        if (ast->forinit)
+            lower_stmt(ast->forinit);
+        Block *head = new_block(), *body = new_block(), *end = new_block();
+        emit_jmp(head);
+        cur = head;
+        if (ast->forcond)
+        {
+            Inst *cond = lower_expr(ast->forcond);
+            set_result(cond);
+            emit_br(cond, body, end);
+        }
+        else
+            emit_jmp(body);
+        seal_block(body);
+        cur = body;
+        lower_stmt(ast->forbody);
+        if (ast->forstep)
+            set_result(lower_expr(ast->forstep));
+        emit_jmp(head);
+        seal_block(head);
+        seal_block(end);
+        cur = end;
+        return;
+    }
+    case AST_RET:
+    {
+        Inst *v = lower_expr(ast->retval);
+        new_inst(IR_RET, 8, v, NULL);
+        // return 之后的语句不可达
+        cur = new_block();
+        seal_block(cur);
+        return;
+    }
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            lower_stmt(vec_get(ast->stmts, i));
+        return;
+    default:
+        set_result(lower_expr(ast));
+    }
+}
+
+// 找出被取了地址的局部变量，它们只能放在栈上
+static void mark_address_taken(Ast *ast)
+{
+    if (!ast)
+        return;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return;
+    case AST_ADDR:
+        if (ast->operand->type == AST_LVAR)
+            ast->operand->lid = -1;
+        else
+            mark_address_taken(ast->operand);
+        return;
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        mark_address_taken(ast->operand);
+        return;
+    case AST_FUNCALL:
+        for (int i = 0; i < vec_len(ast->args); i++)
+            mark_address_taken(vec_get(ast->args, i));
+        return;
+    case AST_DECL:
+        if (ast->decl_init && ast->decl_init->type == AST_ARRAY_INIT)
+            for (int i = 0; i < vec_len(ast->decl_init->array_init); i++)
+                mark_address_taken(vec_get(ast->decl_init->array_init, i));
+        else
+            mark_address_taken(ast->decl_init);
+        return;
+    case AST_IF:
+        mark_address_taken(ast->cond);
+        mark_address_taken(ast->then);
+        mark_address_taken(ast->els);
+        return;
+    case AST_FOR:
+        mark_address_taken(ast->forinit);
+        mark_address_taken(ast->forcond);
+        mark_address_taken(ast->forstep);
+        mark_address_taken(ast->forbody);
+        return;
+    case AST_RET:
+        mark_address_taken(ast->retval);
+        return;
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            mark_address_taken(vec_get(ast->stmts, i));
+        return;
+    default:
+        mark_address_taken(ast->left);
+        mark_address_taken(ast->right);
+    }
+}
+
+/**
+ * @brief 给变量编号，标量并且没有被取地址的变量用SSA值表示，其它变量放在栈上
+ */
+static void classify_var(Ast *var)
+{
+    if (var->ctype->type == CTYPE_ARRAY || var->lid < 0)
+    {
+        var->lid = -1;
+        vec_push(mem_vars, var);
+        return;
+    }
+    var->lid = vec_len(ssa_vars);
+    vec_push(ssa_vars, var);
+}
+
+// 删除结果没有被使用、并且没有副作用的指令
+static void remove_dead_code(void)
+{
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (int i = 0; i < vec_len(blocks); i++)
+        {
+            Block *b = vec_get(blocks, i);
+            for (int j = 0; j < vec_len(b->phis); j++)
+                ((Inst *)vec_get(b->phis, j))->uses = 0;
+            for (int j = 0; j < vec_len(b->insts); j++)
+                ((Inst *)vec_get(b->insts, j))->uses = 0;
+        }
+        for (int i = 0; i < vec_len(blocks); i++)
+        {
+            Block *b = vec_get(blocks, i);
+            for (int k = 0; k < 2; k++)
+            {
+                Vector *list = k ? b->insts : b->phis;
+                for (int j = 0; j < vec_len(list); j++)
+                {
+                    Inst *v = vec_get(list, j);
+                    if (v->a)
+                        v->a->uses++;
+                    if (v->b)
+                        v->b->uses++;
+                    for (int n = 0; v->args && n < vec_len(v->args); n++)
+                        ((Inst *)vec_get(v->args, n))->uses++;
+                }
+            }
+        }
+        for (int i = 0; i < vec_len(blocks); i++)
+        {
+            Block *b = vec_get(blocks, i);
+            for (int k = 0; k < 2; k++)
+            {
+                Vector *list = k ? b->insts : b->phis;
+                int n = 0;
+                for (int j = 0; j < vec_len(list); j++)
+                {
+                    Inst *v = vec_get(list, j);
+                    bool pure = v->op != IR_STORE && v->op != IR_CALL && v->op != IR_JMP &&
+                                v->op != IR_BR && v->op != IR_RET;
+                    if (pure && v->uses == 0)
+                    {
+                        changed = true;
+                        continue;
+                    }
+                    list->body[n++] = v;
+                }
+                list->len = n;
+            }
+        }
+    }
+}
+
+// 把所有操作数替换为消除平凡phi之后的值，并删除被消除的phi
+static void resolve_operands(void)
+{
+    for (int i = 0; i < vec_len(blocks); i++)
+    {
+        Block *b = vec_get(blocks, i);
+        int n = 0;
+        for (int j = 0; j < vec_len(b->phis); j++)
+        {
+            Inst *phi = vec_get(b->phis, j);
+            if (phi->forward)
+                continue;
+            for (int k = 0; k < vec_len(phi->args); k++)
+                phi->args->body[k] = resolve(vec_get(phi->args, k));
+            b->phis->body[n++] = phi;
+        }
+        b->phis->len = n;
+        for (int j = 0; j < vec_len(b->insts); j++)
+        {
+            Inst *v = vec_get(b->insts, j);
+            v->a = resolve(v->a);
+            v->b = resolve(v->b);
+            for (int k = 0; v->args && k < vec_len(v->args); k++)
+                v->args->body[k] = resolve(vec_get(v->args, k));
+        }
+    }
+}
+
+/**
+ * @brief 将函数的抽象语法树翻译成SSA形式的中间表示
+ */
+static void build_ir(Ast *func)
+{
+    blocks = make_vector();
+    ssa_vars = make_vector();
+    mem_vars = make_vector();
+    nvalues = 0;
+    // 0号变量是函数的返回值
+    vec_push(ssa_vars, NULL);
+    for (int i = 0; i < vec_len(func->params); i++)
+        ((Ast *)vec_get(func->params, i))->lid = 0;
+    for (int i = 0; i < vec_len(func->locals); i++)
+        ((Ast *)vec_get(func->locals, i))->lid = 0;
+    mark_address_taken(func->body);
+    for (int i = 0; i < vec_len(func->params); i++)
+        classify_var(vec_get(func->params, i));
+    for (int i = 0; i < vec_len(func->locals); i++)
+        classify_var(vec_get(func->locals, i));
+
+    cur = new_block();
+    seal_block(cur);
+    for (int i = 0; i < vec_len(func->params); i++)
+    {
+        Ast *param = vec_get(func->params, i);
+        Inst *v = new_inst(IR_PARAM, ir_size(param->ctype), NULL, NULL);
+        v->ival = i;
+        v->var = param;
+        if (param->ctype->type == CTYPE_CHAR)
+            v->size = 1;
+        lower_assign(param, v);
+    }
+    lower_stmt(func->body);
+    if (!is_terminated(cur))
+        new_inst(IR_RET, 8, read_var(cur, 0), NULL);
+    resolve_operands();
+    remove_dead_code();
+}
+
+// ===================== dump ====================
+
+static char *value_name(Inst *v)
+{
+    String *s = make_string();
+    if (v->op == IR_CONST)
+        string_appendf(s, "%d", v->ival);
+    else
+        string_appendf(s, "v%d", v->id);
+    return get_cstring(s);
+}
+
+static void dump_inst(FILE *fp, Inst *v)
+{
+    fprintf(fp, "  ");
+    switch (v->op)
+    {
+    case IR_STORE:
+        fprintf(fp, "store.%d %s, %s\n", v->size, value_name(v->a), value_name(v->b));
+        return;
+    case IR_JMP:
+        fprintf(fp, "jmp b%d\n", v->then->id);
+        return;
+    case IR_BR:
+        fprintf(fp, "br %s, b%d, b%d\n", value_name(v->a), v->then->id, v->els->id);
+        return;
+    case IR_RET:
+        fprintf(fp, "ret %s\n", value_name(v->a));
+        return;
+    }
+    fprintf(fp, "v%d = %s.%d", v->id, IR_NAMES[v->op], v->size);
+    switch (v->op)
+    {
+    case IR_PARAM:
+        fprintf(fp, " %d", v->ival);
+        break;
+    case IR_LADDR:
+        fprintf(fp, " %s", v->var->lname);
+        break;
+    case IR_GADDR:
+        fprintf(fp, " %s", v->label);
+        break;
+    case IR_CALL:
+        fprintf(fp, " %s(", v->label);
+        for (int i = 0; i < vec_len(v->args); i++)
+            fprintf(fp, "%s%s", i ? ", " : "", value_name(vec_get(v->args, i)));
+        fprintf(fp, ")");
+        break;
+    case IR_PHI:
+        for (int i = 0; i < vec_len(v->args); i++)
+            fprintf(fp, "%s [%s, b%d]", i ? "," : "", value_name(vec_get(v->args, i)),
+                    ((Block *)vec_get(v->block->preds, i))->id);
+        break;
+    case IR_SAR:
+        fprintf(fp, " %s, %d", value_name(v->a), v->ival);
+        break;
+    default:
+        fprintf(fp, " %s", value_name(v->a));
+        if (v->b)
+            fprintf(fp, ", %s", value_name(v->b));
+    }
+    if (v->op == IR_PHI && v->var)
+        fprintf(fp, "  ; %s", v->var->lname);
+    fprintf(fp, "\n");
+}
+
+static void dump_ir(FILE *fp, Ast *func)
+{
+    fprintf(fp, "func %s(", func->fname);
+    for (int i = 0; i < vec_len(func->params); i++)
+        fprintf(fp, "%s%s", i ? ", " : "", ((Ast *)vec_get(func->params, i))->lname);
+    fprintf(fp, ")\n");
+    for (int i = 0; i < vec_len(blocks); i++)
+    {
+        Block *b = vec_get(blocks, i);
+        // 跳过不可达的基本块
+        if (i > 0 && !vec_len(b->preds))
+            continue;
+        fprintf(fp, "b%d:", b->id);
+        if (vec_len(b->preds))
+        {
+            fprintf(fp, "  ; preds");
+            for (int j = 0; j < vec_len(b->preds); j++)
+                fprintf(fp, " b%d", ((Block *)vec_get(b->preds, j))->id);
+        }
+        fprintf(fp, "\n");
+        for (int j = 0; j < vec_len(b->phis); j++)
+            dump_inst(fp, vec_get(b->phis, j));
+        for (int j = 0; j < vec_len(b->insts); j++)
+            dump_inst(fp, vec_get(b->insts, j));
+    }
+    fprintf(fp, "\n");
+}
+
+// ===================== x86-64 ====================
+
+/**
+ * 每个SSA值在栈上有一个8字节的位置，指令从栈上读取操作数，结果写回栈上
+ * phi 另外有一个入口位置，前驱基本块跳转之前把操作数写到入口位置，
+ * 进入基本块时再拷贝到phi自己的位置，这样同一个基本块的多个phi之间互不影响
+ */
+
+static char *REGS[] = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+static char *REGS32[] = {"edi", "esi", "edx", "ecx", "r8d", "r9d"};
+static char *REGS8[] = {"dil", "sil", "dl", "cl", "r8b", "r9b"};
+
+// 操作数的文本形式，常量是立即数，其它值在栈上
+static char *operand(Inst *v)
+{
+    String *s = make_string();
+    if (v->op == IR_CONST)
+        string_appendf(s, "$%d", v->ival);
+    else
+        string_appendf(s, "-%d(%%rbp)", v->off);
+    return get_cstring(s);
+}
+
+// 将值加载到rax或rcx中，int 只加载低32位
+static void load_value(Inst *v, char *reg64, char *reg32)
+{
+    if (v->size == 8 && v->op != IR_CONST)
+        emit("mov %s, %%%s", operand(v), reg64);
+    else
+        emit("mov %s, %%%s", operand(v), reg32);
+}
+
+// 条件判断时操作数a所在的寄存器
+static char *reg_a(Inst *v)
+{
+    return v->a->size == 8 && v->a->op != IR_CONST ? "rax" : "eax";
+}
+
+static void store_result(Inst *v)
+{
+    emit("mov %%rax, -%d(%%rbp)", v->off);
+}
+
+// 跳转到 to 之前，把 phi 的操作数写到入口位置
+static void emit_phi_copies(Block *from, Block *to)
+{
+    int pred = -1;
+    for (int i = 0; i < vec_len(to->preds); i++)
+        if (vec_get(to->preds, i) == from)
+            pred = i;
+    for (int i = 0; i < vec_len(to->phis); i++)
+    {
+        Inst *phi = vec_get(to->phis, i);
+        load_value(vec_get(phi->args, pred), "rax", "eax");
+        emit("mov %%rax, -%d(%%rbp)", phi->inoff);
+    }
+}
+
+static void emit_inst(Block *b, Inst *v)
+{
+    static char *arith[] = {[IR_ADD] = "add", [IR_SUB] = "sub", [IR_MUL] = "imul"};
+    static char *setcc[] = {[IR_LT] = "setl", [IR_GT] = "setg", [IR_EQ] = "sete"};
+    switch (v->op)
+    {
+    case IR_PARAM:
+        if (v->size == 1)
+            emit("movzbl %%%s, %%eax", REGS8[v->ival]);
+        else if (v->size == 4)
+            emit("mov %%%s, %%eax", REGS32[v->ival]);
+        else
+            emit("mov %%%s, %%rax", REGS[v->ival]);
+        break;
+    case IR_LADDR:
+        emit("lea -%d(%%rbp), %%rax", v->var->loff);
+        break;
+    case IR_GADDR:
+        emit("lea %s(%%rip), %%rax", v->label);
+        break;
+    case IR_LOAD:
+        load_value(v->a, "rax", "eax");
+        if (v->size == 1)
+            emit("movzbl (%%rax), %%eax");
+        else if (v->size == 4)
+            emit("mov (%%rax), %%eax");
+        else
+            emit("mov (%%rax), %%rax");
+        break;
+    case IR_STORE:
+        load_value(v->a, "rcx", "ecx");
+        load_value(v->b, "rax", "eax");
+        if (v->size == 1)
+            emit("mov %%al, (%%rcx)");
+        else if (v->size == 4)
+            emit("mov %%eax, (%%rcx)");
+        else
+            emit("mov %%rax, (%%rcx)");
+        return;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+        load_value(v->a, "rax", "eax");
+        if (v->size == 8)
+        {
+            load_value(v->b, "rcx", "ecx");
+            emit("%s %%rcx, %%rax", arith[v->op]);
+        }
+        else
+            emit("%s %s, %%eax", arith[v->op], operand(v->b));
+        break;
+    case IR_DIV:
+        load_value(v->a, "rax", "eax");
+        load_value(v->b, "rcx", "ecx");
+        emit("cltd");
+        emit("idiv %%ecx");
+        break;
+    case IR_SAR:
+        load_value(v->a, "rax", "eax");
+        emit("sar $%d, %%rax", v->ival);
+        break;
+    case IR_LT:
+    case IR_GT:
+    case IR_EQ:
+        load_value(v->a, "rax", "eax");
+        emit("cmp %s, %%eax", operand(v->b));
+        emit("%s %%al", setcc[v->op]);
+        emit("movzbl %%al, %%eax");
+        break;
+    case IR_NOT:
+        load_value(v->a, "rax", "eax");
+        emit("test %%%s, %%%s", reg_a(v), reg_a(v));
+        emit("sete %%al");
+        emit("movzbl %%al, %%eax");
+        break;
+    case IR_SEXT:
+        load_value(v->a, "rax", "eax");
+        emit("movslq %%eax, %%rax");
+        break;
+    case IR_ZEXT8:
+        load_value(v->a, "rax", "eax");
+        emit("movzbl %%al, %%eax");
+        break;
+    case IR_CALL:
+        for (int i = 0; i < vec_len(v->args); i++)
+        {
+            Inst *arg = vec_get(v->args, i);
+            load_value(arg, REGS[i], REGS32[i]);
+        }
+        emit("mov $0, %%eax");
+        emit("call %s", v->label);
+        break;
+    case IR_JMP:
+        emit_phi_copies(b, v->then);
+        emit("jmp %s", v->then->label);
+        return;
+    case IR_BR:
+        emit_phi_copies(b, v->then);
+        emit_phi_copies(b, v->els);
+        load_value(v->a, "rax", "eax");
+        emit("test %%%s, %%%s", reg_a(v), reg_a(v));
+        emit("jne %s", v->then->label);
+        emit("jmp %s", v->els->label);
+        return;
+    case IR_RET:
+        load_value(v->a, "rax", "eax");
+        emit("leave");
+        emit("ret");
+        return;
+    default:
+        error("internal error: %s", IR_NAMES[v->op]);
+    }
+    store_result(v);
+}
+
+static void emit_ir_func(Ast *func)
+{
+    // 分配栈空间：栈上的局部变量，然后是每个SSA值
+    int off = 0;
+    for (int i = 0; i < vec_len(mem_vars); i++)
+    {
+        Ast *var = vec_get(mem_vars, i);
+        off += (ctype_size(var->ctype) + 7) & ~7;
+        var->loff = off;
+    }
+    for (int i = 0; i < vec_len(blocks); i++)
+    {
+        Block *b = vec_get(blocks, i);
+        for (int j = 0; j < vec_len(b->phis); j++)
+        {
+            Inst *phi = vec_get(b->phis, j);
+            phi->off = (off += 8);
+            phi->inoff = (off += 8);
+        }
+        for (int j = 0; j < vec_len(b->insts); j++)
+            ((Inst *)vec_get(b->insts, j))->off = (off += 8);
+    }
+    emit(".text");
+    emit(".global %s", func->fname);
+    emit_label("%s:", func->fname);
+    emit("push %%rbp");
+    emit("mov %%rsp, %%rbp");
+    off = (off + 15) & ~15;
+    if (off)
+        emit("sub $%d, %%rsp", off);
+    for (int i = 0; i < vec_len(blocks); i++)
+    {
+        Block *b = vec_get(blocks, i);
+        if (i > 0 && !vec_len(b->preds))
+            continue;
+        emit_label("%s:", b->label);
+        for (int j = 0; j < vec_len(b->phis); j++)
+        {
+            Inst *phi = vec_get(b->phis, j);
+            emit("mov -%d(%%rbp), %%rax", phi->inoff);
+            emit("mov %%rax, -%d(%%rbp)", phi->off);
+        }
+        for (int j = 0; j < vec_len(b->insts); j++)
+            emit_inst(b, vec_get(b->insts, j));
+    }
+}
+
+/**
+ * @brief 构造函数的中间表示，-fdump-ir 时输出到标准错误
+ * @return -fssa 时由中间表示生成代码，返回true；否则返回false，由gen.c直接生成代码
+ */
+bool emit_ir(Ast *func)
+{
+    if (!flag_ssa && !flag_dump_ir)
+        return false;
+    build_ir(func);
+    if (flag_dump_ir)
+        dump_ir(stderr, func);
+    if (!flag_ssa)
+        return false;
+    emit_ir_func(func);
+    return true;
+}
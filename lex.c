@@ -10,64 +10,348 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <ctype.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "qcc.h"
 
 #define BUFLEN 256
+// 输入缓冲区末尾额外填充的 '\0' 字节数，保证扫描时越过结尾也不会访问非法内存
+#define INPUT_PAD 64
 
-static Token *ungotten = NULL;
+// 字符分类
+enum
+{
+    C_SPACE = 1,
+    C_DIGIT = 2,
+    // 可以作为标识符首字符: 字母或下划线
+    C_ALPHA = 4,
+    // 可以出现在标识符中: 字母、数字、下划线
+    C_IDENT = 8,
+    // 单字符的符号
+    C_PUNCT = 16,
+};
+
+static const unsigned char char_class[256] = {
+    [' '] = C_SPACE, ['\t'] = C_SPACE, ['\n'] = C_SPACE,
+    ['\v'] = C_SPACE, ['\f'] = C_SPACE, ['\r'] = C_SPACE,
+    ['0' ... '9'] = C_DIGIT | C_IDENT,
+    ['a' ... 'z'] = C_ALPHA | C_IDENT,
+    ['A' ... 'Z'] = C_ALPHA | C_IDENT,
+    ['_'] = C_ALPHA | C_IDENT,
+    ['/'] = C_PUNCT, ['*'] = C_PUNCT, ['('] = C_PUNCT, [')'] = C_PUNCT,
+    [','] = C_PUNCT, [';'] = C_PUNCT, ['&'] = C_PUNCT, ['['] = C_PUNCT,
+    [']'] = C_PUNCT, ['{'] = C_PUNCT, ['}'] = C_PUNCT, ['!'] = C_PUNCT,
+    ['>'] = C_PUNCT, ['<'] = C_PUNCT,
+};
+
+/**
+ * 整个翻译单元预先被切分成一个连续的 Token 数组
+ * parser 通过下标 pos 顺序访问，可以向前看任意多个 token
+ */
+static Token *tokens;
+static int ntokens;
+static int tokens_cap;
+static int pos;
+
+/**
+ * 标识符表，所有同名标识符共享同一个字符串指针
+ * 这样 parser 中比较名字只需要比较指针
+ * 关键字事先放入表中并打上标记，词法分析时就能区分关键字和普通标识符
+ */
+typedef struct
+{
+    char *name;
+    int len;
+    unsigned hash;
+    // 关键字编号，普通标识符为 -1
+    int keyword;
+} Ident;
+
+static Ident *idents;
+static int nidents;
+// 表的容量，总是2的幂
+static int idents_cap;
+
+static char *keywords[] = {
+    [KW_IF] = "if",
+    [KW_ELSE] = "else",
+    [KW_FOR] = "for",
+    [KW_RETURN] = "return",
+    [KW_INT] = "int",
+    [KW_CHAR] = "char",
+};
+
+// 整个源文件一次性映射(或读入)到内存，词法分析直接通过指针扫描
+// 缓冲区以 '\0' 结尾，遇到 '\0' 即认为输入结束
+static char *p;
+
+/**
+ * @brief 将源文件整体 mmap 到内存
+ * 先预留一段匿名映射(多出 INPUT_PAD 字节)，再把文件以 MAP_FIXED 覆盖到开头，
+ * 这样文件末尾之后一定是全零的可读内存
+ */
+static char *map_file(char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        error("Cannot open %s", filename);
+    struct stat st;
+    if (fstat(fd, &st) < 0)
+        error("Cannot stat %s", filename);
+    size_t size = st.st_size;
+    size_t pagesz = sysconf(_SC_PAGESIZE);
+    size_t maplen = (size + INPUT_PAD + pagesz - 1) & ~(pagesz - 1);
+    char *buf = mmap(NULL, maplen, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED)
+        error("Cannot map %s", filename);
+    if (size && mmap(buf, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+        error("Cannot map %s", filename);
+    close(fd);
+    return buf;
+}
+
+// 标准输入无法mmap，一次性读入到一块连续的缓冲区
+static char *read_stdin(void)
+{
+    size_t nalloc = 1 << 16, len = 0;
+    char *buf = malloc(nalloc);
+    for (;;)
+    {
+        if (len + INPUT_PAD >= nalloc)
+            buf = realloc(buf, nalloc <<= 1);
+        ssize_t n = read(0, buf + len, nalloc - len - INPUT_PAD);
+        if (n < 0)
+            error("Cannot read stdin");
+        if (n == 0)
+            break;
+        len += n;
+    }
+    memset(buf + len, 0, INPUT_PAD);
+    return buf;
+}
+
+// FNV-1a
+static unsigned hash_name(char *s, int len)
+{
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static void rehash_idents(void)
+{
+    Ident *old = idents;
+    int oldcap = idents_cap;
+    idents_cap = oldcap ? oldcap << 1 : 256;
+    idents = calloc(idents_cap, sizeof(Ident));
+    for (int i = 0; i < oldcap; i++)
+    {
+        if (!old[i].name)
+            continue;
+        int j = old[i].hash & (idents_cap - 1);
+        while (idents[j].name)
+            j = (j + 1) & (idents_cap - 1);
+        idents[j] = old[i];
+    }
+    free(old);
+}
+
+/**
+ * @brief 在标识符表中查找长度为len的名字，不存在则插入一份拷贝
+ */
+static Ident *lookup_ident(char *s, int len)
+{
+    if ((nidents + 1) * 2 > idents_cap)
+        rehash_idents();
+    unsigned h = hash_name(s, len);
+    int i = h & (idents_cap - 1);
+    for (; idents[i].name; i = (i + 1) & (idents_cap - 1))
+    {
+        Ident *id = &idents[i];
+        if (id->hash == h && id->len == len && !memcmp(id->name, s, len))
+            return id;
+    }
+    Ident *id = &idents[i];
+    id->name = qalloc(len + 1);
+    memcpy(id->name, s, len);
+    id->name[len] = '\0';
+    id->len = len;
+    id->hash = h;
+    id->keyword = -1;
+    nidents++;
+    return id;
+}
+
+// 返回标识符的唯一实例
+char *intern(char *s)
+{
+    return lookup_ident(s, strlen(s))->name;
+}
+
+static Token *read_token_dispatcher(void);
+
+/**
+ * @brief 初始化词法分析器的输入
+ * @param filename 源文件名，为NULL时从标准输入读取
+ */
+void lex_init(char *filename)
+{
+    p = filename ? map_file(filename) : read_stdin();
+    for (int i = 0; i < sizeof(keywords) / sizeof(*keywords); i++)
+        lookup_ident(keywords[i], strlen(keywords[i]))->keyword = i;
+    // 一次性完成整个翻译单元的词法分析
+    while (read_token_dispatcher())
+        ;
+    pos = 0;
+}
+
+// 在 Token 数组末尾分配一个新的 token
+static Token *make_token(int type)
+{
+    if (ntokens == tokens_cap)
+    {
+        tokens_cap = tokens_cap ? tokens_cap << 1 : 1024;
+        tokens = realloc(tokens, tokens_cap * sizeof(Token));
+    }
+    Token *r = &tokens[ntokens++];
+    r->type = type;
+    r->len = 0;
+    return r;
+}
+
+static Token *make_ident(char *name)
+{
+    Token *r = make_token(TTYPE_IDENT);
+    r->sval = name;
+    return r;
+}
 
-static Token *make_ident(String *s)
+static Token *make_keyword(int keyword)
 {
-    Token *r = malloc(sizeof(Token));
-    r->type = TTYPE_IDENT;
-    r->sval = get_cstring(s);
+    Token *r = make_token(TTYPE_KEYWORD);
+    r->keyword = keyword;
     return r;
 }
 
-static Token *make_strtok(String *s)
+/**
+ * 字符串常量只记录在源码中的位置和长度(不含引号)，
+ * 用到的时候再通过 token_sval 解析转义字符
+ */
+static Token *make_strtok(char *start, int len)
 {
-    Token *r = malloc(sizeof(Token));
-    r->type = TTYPE_STRING;
-    r->sval = get_cstring(s);
+    Token *r = make_token(TTYPE_STRING);
+    r->sval = start;
+    r->len = len;
     return r;
 }
 
 static Token *make_punct(int punct)
 {
-    Token *r = malloc(sizeof(Token));
-    r->type = TTYPE_PUNCT;
+    Token *r = make_token(TTYPE_PUNCT);
     r->punct = punct;
     return r;
 }
 
 static Token *make_int(int ival)
 {
-    Token *r = malloc(sizeof(Token));
-    r->type = TTYPE_INT;
+    Token *r = make_token(TTYPE_INT);
     r->ival = ival;
     return r;
 }
 
 static Token *make_char(char c)
 {
-    Token *r = malloc(sizeof(Token));
-    r->type = TTYPE_CHAR;
+    Token *r = make_token(TTYPE_CHAR);
     r->c = c;
     return r;
 }
 
-static int getc_nonspace(void)
+/**
+ * @brief 跳过连续的空白字符
+ * 支持SSE2时每次比较16个字节，输入缓冲区末尾有足够的'\0'填充，不会越界
+ */
+static char *skip_space_run(char *q)
 {
-    int c;
-    while ((c = getc(stdin)) != EOF)
+#ifdef __SSE2__
+    if (!(char_class[(unsigned char)*q] & C_SPACE))
+        return q;
+    for (;;)
     {
-        if (isspace(c) || c == '\n' || c == '\r')
+        __m128i v = _mm_loadu_si128((__m128i *)q);
+        // ' ' 以及 \t \n \v \f \r (0x09 ~ 0x0d)
+        __m128i sp = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+        __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x08)),
+                                    _mm_cmplt_epi8(v, _mm_set1_epi8(0x0e)));
+        unsigned mask = _mm_movemask_epi8(_mm_or_si128(sp, ctl));
+        if (mask != 0xffff)
+            return q + __builtin_ctz(~mask);
+        q += 16;
+    }
+#else
+    while (char_class[(unsigned char)*q] & C_SPACE)
+        q++;
+    return q;
+#endif
+}
+
+// 跳过连续的标识符字符(字母、数字、下划线)
+static char *skip_ident_run(char *q)
+{
+#ifdef __SSE2__
+    for (;;)
+    {
+        __m128i v = _mm_loadu_si128((__m128i *)q);
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+        __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('a' - 1)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8('z' + 1)));
+        __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+        __m128i m = _mm_or_si128(_mm_or_si128(digit, upper), _mm_or_si128(lower, under));
+        unsigned mask = _mm_movemask_epi8(m);
+        if (mask != 0xffff)
+            return q + __builtin_ctz(~mask);
+        q += 16;
+    }
+#else
+    while (char_class[(unsigned char)*q] & C_IDENT)
+        q++;
+    return q;
+#endif
+}
+
+// 跳过空白字符以及 // 和 /* */ 注释
+static void skip_space(void)
+{
+    for (;;)
+    {
+        p = skip_space_run(p);
+        if (p[0] != '/')
+            return;
+        if (p[1] == '/')
+        {
+            char *nl = strchr(p + 2, '\n');
+            p = nl ? nl + 1 : p + strlen(p);
+            continue;
+        }
+        if (p[1] == '*')
+        {
+            char *end = strstr(p + 2, "*/");
+            if (!end)
+                error("Unterminated comment");
+            p = end + 2;
             continue;
-        return c;
+        }
+        return;
     }
-    return EOF;
 }
 
 /**
@@ -77,16 +361,9 @@ static int getc_nonspace(void)
 static Token *read_number(char c)
 {
     int n = c - '0';
-    for (;;)
-    {
-        c = getc(stdin);
-        if (!isdigit(c))
-        {
-            ungetc(c, stdin);
-            return make_int(n);
-        }
-        n = n * 10 + c - '0';
-    }
+    while (char_class[(unsigned char)*p] & C_DIGIT)
+        n = n * 10 + *p++ - '0';
+    return make_int(n);
 }
 
 /**
@@ -94,17 +371,17 @@ static Token *read_number(char c)
  */
 static Token *read_char(void)
 {
-    char c = getc(stdin);
-    if (c == EOF)
+    char c = *p++;
+    if (c == '\0')
         goto err;
     if (c == '\\')
     {
-        c = getc(stdin);
-        if (c == EOF)
+        c = *p++;
+        if (c == '\0')
             goto err;
     }
-    char c2 = getc(stdin);
-    if (c2 == EOF)
+    char c2 = *p++;
+    if (c2 == '\0')
         goto err;
     if (c2 != '\'')
         error("Malformed char literal");
@@ -119,29 +396,47 @@ err:
  */
 static Token *read_string(void)
 {
-    String *s = make_string();
+    char *start = p;
     for (;;)
     {
-        int c = getc(stdin);
-        if (c == EOF)
+        int c = *p++;
+        if (c == '\0')
             error("Unterminated string");
         if (c == '"')
             break;
         if (c == '\\')
         {
-            c = getc(stdin);
+            c = *p++;
             switch(c){
-                case EOF: error("Unterminated \\");
-                case '\\': break;
+                case '\0': error("Unterminated \\");
+                case '\\': case 'n': case 't': case '\"': break;
+                default: error("Unknown quote: %c", c);
+            }
+        }
+    }
+    return make_strtok(start, p - start - 1);
+}
+
+// 将字符串常量 token 中的转义字符解析出来，得到真正的字符串
+char *token_sval(Token *tok)
+{
+    assert(tok->type == TTYPE_STRING);
+    String *s = make_string();
+    char *end = tok->sval + tok->len;
+    for (char *q = tok->sval; q < end; q++)
+    {
+        char c = *q;
+        if (c == '\\')
+        {
+            switch(*++q){
                 case 'n': c = '\n'; break;
                 case 't': c = '\t'; break;
-                case '\"': c = '\"'; break; 
-                default: error("Unknown quote: %c", c);
+                default: c = *q; break;
             }
         }
         string_append(s, c);
     }
-    return make_strtok(s);
+    return get_cstring(s);
 }
 
 /**
@@ -151,21 +446,12 @@ static Token *read_string(void)
  */
 static Token *read_ident(char c)
 {
-    String *s = make_string();
-    string_append(s, c);
-    for (;;)
-    {
-        int c2 = getc(stdin);
-        if (isalnum(c2) || c2 == '_')
-        {
-            string_append(s, c2);
-        }
-        else
-        {
-            ungetc(c2, stdin);
-            return make_ident(s);
-        }
-    }
+    char *start = p - 1;
+    p = skip_ident_run(p);
+    Ident *id = lookup_ident(start, p - start);
+    if (id->keyword >= 0)
+        return make_keyword(id->keyword);
+    return make_ident(id->name);
 }
 
 /**
@@ -177,9 +463,10 @@ static Token *read_ident(char c)
  * @param punct_type 这两个字符构成的punctuation类型
  */
 static Token *read_repeat(int c1, int expect, int punct_type){
-    int c = getc(stdin);
-    if(c == expect) return make_punct(punct_type);
-    ungetc(c, stdin);
+    if(*p == expect){
+        p++;
+        return make_punct(punct_type);
+    }
     return make_punct(c1);
 }
 
@@ -188,98 +475,27 @@ static Token *read_repeat(int c1, int expect, int punct_type){
  */
 static Token *read_token_dispatcher(void)
 {
-    int c = getc_nonspace();
+    skip_space();
+    int c = (unsigned char)*p;
+    if (c == '\0')
+        return NULL;
+    p++;
+    int cls = char_class[c];
+    if (cls & C_DIGIT)
+        return read_number(c);
+    if (cls & C_ALPHA)
+        return read_ident(c);
+    if (cls & C_PUNCT)
+        return make_punct(c);
     switch (c)
     {
-    case '0':
-    case '1':
-    case '2':
-    case '3':
-    case '4':
-    case '5':
-    case '6':
-    case '7':
-    case '8':
-    case '9':
-        return read_number(c);
     case '"':
         return read_string();
     case '\'':
         return read_char();
-    case 'a':
-    case 'b':
-    case 'c':
-    case 'd':
-    case 'e':
-    case 'f':
-    case 'g':
-    case 'h':
-    case 'i':
-    case 'j':
-    case 'k':
-    case 'l':
-    case 'm':
-    case 'n':
-    case 'o':
-    case 'p':
-    case 'q':
-    case 'r':
-    case 's':
-    case 't':
-    case 'u':
-    case 'v':
-    case 'w':
-    case 'x':
-    case 'y':
-    case 'z':
-    case 'A':
-    case 'B':
-    case 'C':
-    case 'D':
-    case 'E':
-    case 'F':
-    case 'G':
-    case 'H':
-    case 'I':
-    case 'J':
-    case 'K':
-    case 'L':
-    case 'M':
-    case 'N':
-    case 'O':
-    case 'P':
-    case 'Q':
-    case 'R':
-    case 'S':
-    case 'T':
-    case 'U':
-    case 'V':
-    case 'W':
-    case 'X':
-    case 'Y':
-    case 'Z':
-    case '_':
-        return read_ident(c);
-    case '/':
-    case '*':
-    case '(':
-    case ')':
-    case ',':
-    case ';':
-    case '&':
-    case '[':
-    case ']':
-    case '{':
-    case '}':
-    case '!':
-    case '>':
-    case '<':
-        return make_punct(c);
     case '=': return read_repeat('=', '=', PUNCT_EQ);
     case '+': return read_repeat('+', '+', PUNCT_INC);
     case '-': return read_repeat('-', '-', PUNCT_DEC);
-    case EOF:
-        return NULL;
     default:
         error("Unexpected character: '%c'", c);
     }
@@ -292,6 +508,8 @@ char *token_to_string(Token *tok)
     {
     case TTYPE_IDENT:
         return tok->sval;
+    case TTYPE_KEYWORD:
+        return keywords[tok->keyword];
     case TTYPE_PUNCT:
     case TTYPE_CHAR:
     {
@@ -308,7 +526,7 @@ char *token_to_string(Token *tok)
     case TTYPE_STRING:
     {
         String *s = make_string();
-        string_appendf(s, "\"%s\"", tok->sval);
+        string_appendf(s, "\"%.*s\"", tok->len, tok->sval);
         return get_cstring(s);
     }
     default:
@@ -324,39 +542,44 @@ bool is_punct(Token *tok, int c)
     return tok->type == TTYPE_PUNCT && tok->punct == c;
 }
 
-bool is_ident(Token *tok, char *s){
-    if(!tok) error("Unexpected terminate when determine whether a token is identifier");
-    return tok->type == TTYPE_IDENT && !strcmp(tok->sval, s);
+// token是否是关键字 kw
+bool is_keyword(Token *tok, int kw)
+{
+    if (!tok)
+        error("Unexpected terminate when determine whether a token is keyword");
+    return tok->type == TTYPE_KEYWORD && tok->keyword == kw;
 }
 
-// 将token 回退到 大小为1 的Token缓冲区
+// 回退最近读取的一个token
 void unget_token(Token *tok)
 {
-    if (ungotten)
-        error("Push back buffer is already full");
-    ungotten = tok;
+    if (!tok)
+        return;
+    if (pos == 0 || tok != &tokens[pos - 1])
+        error("Only the last read token can be pushed back");
+    pos--;
 }
 
 /**
- * 从缓冲区中读取下一个token
+ * 读取下一个token，到达末尾时返回NULL
  */
 Token *read_token(void)
 {
-    // 首先从缓冲区获取
-    if (ungotten)
-    {
-        Token *tok = ungotten;
-        ungotten = NULL;
-        return tok;
-    }
-    // 缓冲区无Token，则通过全局调度器读取
-    return read_token_dispatcher();
+    if (pos == ntokens)
+        return NULL;
+    return &tokens[pos++];
+}
+
+// 向前看第n个token(从0开始)，并不移动读取位置
+Token *peek_token_n(int n)
+{
+    if (pos + n >= ntokens)
+        return NULL;
+    return &tokens[pos + n];
 }
 
 // 只是比较当前token，并不从缓冲区中删除
 Token *peek_token()
 {
-    Token *tok = read_token();
-    unget_token(tok);
-    return tok;
-}
\ No newline at end of file
+    return peek_token_n(0);
+}
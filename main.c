@@ -14,30 +14,168 @@
 #include <setjmp.h>
 #include "qcc.h"
 
-// 最大表达式的数量
-#define EXPR_LEN 100
+/**
+ * -f 开头的编译选项，-fno-xxx 关闭对应的选项
+ * level 表示从哪个优化级别开始默认打开，0 表示默认关闭
+ */
+static struct
+{
+    char *name;
+    bool *flag;
+    int level;
+    // 命令行中显式指定的值，-1 表示未指定
+    int set;
+} flags[] = {
+    // 在每一行汇编代码后面注释产生它的gen.c行号
+    {"verbose-asm", &flag_verbose_asm, 0, -1},
+    // 表达式的中间结果放在寄存器中
+    {"register-expr", &flag_register_expr, 1, -1},
+    // 没有被取地址的局部变量和参数放在callee-saved寄存器中，需要 -fregister-expr
+    {"promote-regs", &flag_promote_regs, 1, -1},
+    // 数组下标和指针加法折叠到 base + index * scale + disp 寻址模式中，需要 -fregister-expr
+    {"scaled-index", &flag_scaled_index, 1, -1},
+    // 乘以常数用移位和lea，除以常数用移位或者乘以魔数，需要 -fregister-expr
+    {"strength-reduce", &flag_strength_reduce, 1, -1},
+    // if 和 for 的条件直接生成 cmp 和条件跳转，需要 -fregister-expr
+    {"compare-branch", &flag_compare_branch, 1, -1},
+    // 先计算所有参数再放到参数寄存器中，调用前后不保存参数寄存器，需要 -fregister-expr
+    {"call-args", &flag_call_args, 1, -1},
+    // 叶子函数不建立栈帧，局部变量放在red zone中，参数留在参数寄存器中，需要 -fregister-expr
+    {"omit-leaf-frame", &flag_omit_leaf_frame, 1, -1},
+    // 局部变量按对齐紧凑排列，不同时存活的块作用域变量共用栈空间
+    {"pack-frame", &flag_pack_frame, 1, -1},
+    // 局部数组的常量初始值放在 .rodata 中整块拷贝，没有初始值的部分整块清零
+    {"bulk-init", &flag_bulk_init, 1, -1},
+    // for 循环的条件放在循环末尾判断，入口处只判断一次
+    {"rotate-loops", &flag_rotate_loops, 1, -1},
+    // 把循环中不变的计算提到循环前面
+    {"licm", &flag_licm, 1, -1},
+    // 展开次数在编译时已知的循环，代码会变大，-O2 开始打开
+    {"unroll-loops", &flag_unroll_loops, 2, -1},
+    // 把之前定义的小函数的函数体复制到调用的地方，代码会变大，-O2 开始打开
+    {"inline-functions", &flag_inline_functions, 2, -1},
+    // return 后面的调用直接 jmp 过去，调用自己时跳回函数入口，需要 -fregister-expr -fcall-args
+    {"optimize-sibling-calls", &flag_sibling_calls, 2, -1},
+    // 先把函数翻译成SSA形式的中间表示，再由中间表示生成代码
+    {"ssa", &flag_ssa, 0, -1},
+    // 把中间表示输出到标准错误
+    {"dump-ir", &flag_dump_ir, 0, -1},
+    // 对生成的汇编代码做窥孔优化
+    {"peephole", &flag_peephole, 1, -1},
+};
+
+#define NFLAGS (sizeof(flags) / sizeof(*flags))
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: qcc [-p] [-O<level>] [-fmem-report] [-fpeephole-report] [-funroll-factor=<n>] [-finline-limit=<n>] [-f[no-]<flag>] [file]\n");
+    exit(1);
+}
+
+// 解析 -fxxx 或 -fno-xxx，不认识的选项返回false
+static bool parse_flag(char *arg)
+{
+    bool val = true;
+    if (!strncmp(arg, "no-", 3))
+    {
+        arg += 3;
+        val = false;
+    }
+    for (int i = 0; i < NFLAGS; i++)
+    {
+        if (!strcmp(arg, flags[i].name))
+        {
+            flags[i].set = val;
+            return true;
+        }
+    }
+    return false;
+}
+
+// 未显式指定的选项由优化级别决定
+static void set_flags(int level)
+{
+    for (int i = 0; i < NFLAGS; i++)
+    {
+        if (flags[i].set >= 0)
+            *flags[i].flag = flags[i].set;
+        else
+            *flags[i].flag = flags[i].level && level >= flags[i].level;
+    }
+}
 
 int main(int argc, char **argv)
 {
-    int want_ast_tree = (argc > 1 && !strcmp("-p", argv[1]));
-    List *exprs = make_list();
-    for (int i = 0; i < EXPR_LEN; i++)
+    int want_ast_tree = 0;
+    int mem_report = 0;
+    int peephole_stats = 0;
+    int opt_level = 0;
+    // 源文件名，未指定时从标准输入读取
+    char *infile = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp("-p", argv[i]))
+            want_ast_tree = 1;
+        else if (!strcmp("-fmem-report", argv[i]))
+            mem_report = 1;
+        else if (!strcmp("-fpeephole-report", argv[i]))
+            peephole_stats = 1;
+        else if (!strncmp("-funroll-factor=", argv[i], 16))
+            unroll_factor = atoi(argv[i] + 16);
+        else if (!strncmp("-finline-limit=", argv[i], 15))
+            inline_limit = atoi(argv[i] + 15);
+        else if (!strncmp("-O", argv[i], 2))
+            opt_level = argv[i][2] ? atoi(argv[i] + 2) : 1;
+        else if (!strncmp("-f", argv[i], 2) && parse_flag(argv[i] + 2))
+            continue;
+        else if (argv[i][0] == '-')
+            usage();
+        else if (infile)
+            usage();
+        else
+            infile = argv[i];
+    }
+    set_flags(opt_level);
+    // 标识符、类型等在整个编译过程中都要用到，从 perm_arena 分配
+    perm_arena = make_arena();
+    cur_arena = perm_arena;
+    lex_init(infile);
+    /**
+     * 逐个解析并输出顶层的全局变量定义或函数定义
+     * 每个函数的抽象语法树都从 func_arena 分配，输出之后整体释放
+     * 字符串常量在所有函数输出之后统一输出到 .rodata
+     */
+    Arena *func_arena = make_arena();
+    for (;;)
     {
+        cur_arena = func_arena;
         Ast *ast = parse_decl_or_funcdef();
         if (!ast)
             break;
-        list_append(exprs, ast);
-    }
-    if (!want_ast_tree)
-        emit_data_section_str();
-
-    for (Iter *i = list_iter(exprs); !iter_end(i);)
-    {
-        Ast *ast = iter_next(i);
         if (want_ast_tree)
             printf("%s", ast_to_string(ast));
         else
             emit_toplevel(ast);
+        // 指令链表在 func_arena 中，释放之前输出
+        peephole_flush();
+        arena_reset(func_arena);
+    }
+    cur_arena = perm_arena;
+    if (!want_ast_tree)
+        emit_data_section_str();
+    emit_flush();
+    fflush(stdout);
+    if (peephole_stats)
+    {
+        fprintf(stderr, "peephole:\n");
+        peephole_report(stderr);
+    }
+    if (mem_report)
+    {
+        arena_report("perm arena", perm_arena, stderr);
+        arena_report("func arena", func_arena, stderr);
     }
+    arena_release(func_arena);
+    arena_release(perm_arena);
     return 0;
 }
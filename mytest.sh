@@ -10,7 +10,7 @@
 ### 
 
 function compile {
-  echo "$1" | ./qcc > tmp.s
+  echo "$1" | ./qcc $QCCFLAGS > tmp.s
   if [ $? -ne 0 ]; then
     echo "Failed to compile $1"
     exit
@@ -62,7 +62,7 @@ function test {
 
 function testfail {
   expr="$1"
-  echo "$expr" | ./qcc > /dev/null 2>&1
+  echo "$expr" | ./qcc $QCCFLAGS > /dev/null 2>&1
   if [ $? -eq 0 ]; then
     echo "Should fail to compile, but succeded: $expr"
     exit
@@ -88,6 +88,7 @@ testast '(int)f(){(decl [5]char s "asdf");}' 'char s[]="asdf";'
 testast '(int)f(){(decl [3]int a {1,2,3});}' 'int a[3]={1,2,3};'
 testast '(int)f(){(decl [3]int a {1,2,3});}' 'int a[]={1,2,3};'
 testast '(int)f(){(decl [3][5]int a);}' 'int a[3][5];'
+testast '(int)f(){(decl [2]int a {1,2});(decl [3]int b {3,4,5});}' 'int a[]={1,2};int b[]={3,4,5};'
 testast '(int)f(){(decl [5]int* a);}' 'int *a[5];'
 testast '(int)f(){(decl int a 1);(decl int b 2);(= a (= b 3));}' 'int a=1;int b=2;a=b=3;'
 testast '(int)f(){(decl int a 3);(& a);}' 'int a=3;&a;'
@@ -199,6 +200,23 @@ test 1 'int *a[3]; int b = 2; a[0] = &b; !!**a;'
 # For statement
 test 012340 'for(int i=0; i<5; i=i+1){printf("%d",i);}0;'
 
+# Keywords and identifiers
+test 7 'int iff=3;int fora=4;iff+fora;'
+testfail 'int f(){int if=1;}'
+
+# Comments
+testf 3 $'int f(){ // line comment\n 1 /* block\n comment */ + 2; }'
+testf 2 $'int f(){ 4/2; } // no newline at end'
+testfail 'int f(){ 1; /* unterminated }'
+
+# Block scope
+test 3 'int a=1;{int a=5;}a+2;'
+test 5 'int a=1;{int a=5;a;}'
+test 7 'for(int i=0;i<2;i++){i;} int i=7;i;'
+test 6 'int a=1;{int b=2;{int a=3;b=b*a;}a=b;}a;'
+testfail 'int f(){{int a=1;}a;}'
+testfail 'int f(){for(int i=0;i<2;i++){i;} i;}'
+
 # Type Cast
 test 0 'char a = 256;a;'
 
@@ -228,6 +246,144 @@ testf 23 'int a[3];int f(){a[1]=23;a[1];}'
 testf 25 'int a[3]={24,25,26};int f(){a[1];}'
 testf 195 'char *a = "abc";int f(){a[0] + a[1];}' 
 testf 195 'char a[] = "abc"; int f() { a[0] + a[1]; }'
+# 顶层定义的数量没有上限，字符串常量在所有函数之后输出
+testf 150 "$(for i in $(seq 150); do echo "int g$i(){$i;}"; done) int f(){g150();}"
+testf 'a b 3' 'int g(){printf("a ");} int h(){printf("b ");} int f(){g();h();3;}'
+# 从标准输入读入的源代码超过64KB
+testf 5000 "$(for i in $(seq 5000); do echo "int g$i(){$i;}"; done) int f(){g5000();}"
+# 汇编行的长度没有上限
+long=$(printf 'x%.0s' $(seq 600))
+test "$long 3" "printf(\"%s \",\"$long\");3;"
+
+# Call arguments
+test '-3 -1 -1 -1' 'int a=0-7;int b=0-13;printf("%d %d %d ",a/2,a/4,b/7);b/10;'
+testf 322 'int g(int a,int b,int c){a*100+b*10+c;} int f(){int x=7;g(x/2,g(0,0,x/3),x/7+1);}'
+testf 20 'int g(int a,int b,int c,int d,int e,int f){a+b+c+d+e+f;} int f(){int x=1;g(x+0,x+1,g(1,0,0,0,0,x),x*4,g(x,x,x,x,x,0),x+5);}'
+testf 7 'int g(int a,int b){a-b;} int f(){int *p;int x=9;p=&x;g(*p,g(x,7));}'
+
+# Register evaluation
+test -8123706 '(((((((2-3)+(4*5))*((6-7)+(8*9)))-(((1*2)-(3+4))+((5*6)-(7+8))))+((((9-1)+(2*3))*((4-5)+(6*7)))-(((8*9)-(1+2))+((3*4)-(5+6)))))*(((((7*8)-(9+1))+((2*3)-(4+5)))*(((6+7)*(8-9))-((1+2)*(3-4))))-((((5*6)-(7+8))+((9*1)-(2+3)))*(((4+5)*(6-7))-((8+9)*(1-2))))))-((((((3-4)+(5*6))*((7-8)+(9*1)))-(((2*3)-(4+5))+((6*7)-(8+9))))+((((1-2)+(3*4))*((5-6)+(7*8)))-(((9*1)-(2+3))+((4*5)-(6+7)))))*(((((8*9)-(1+2))+((3*4)-(5+6)))*(((7+8)*(9-1))-((2+3)*(4-5))))-((((6*7)-(8+9))+((1*2)-(3+4)))*(((5+6)*(7-8))-((9+1)*(2-3)))))));'
+test 4 'int a=7;int b=3;int c=2;(a-b)-(c-(a/b));'
+test 14 'int x=100;int y=7;x/y;'
+test 12 'int a[3]={1,2,3};int i=1;a[i+1]=a[i]*(a[0]+5);a[2];'
+test 17 'int a[2]={5,6};int *p=a;*(p+1)=*p+(*(p+1))*2;a[1];'
+test 3 'int a[2]={1,2};int *p=a;p[1]++;a[1];'
+testf 200 'int g(int a){return (a+1)*(a+2);} int f(){int x=3;(x+1)*(g(x)+g(x+1));}'
+
+# Register promotion
+test 45 'int s=0;for(int i=0;i<10;i++){s=s+i;}s;'
+testf 5 'int g(int a){int *p=&a;*p=5;a;} int f(){g(1);}'
+testf 3 'int g(char c){c++;c;} int f(){g(2);}'
+test 0 'char c=255;c++;c;'
+test 30 'int a[3]={10,20,0};int *p=a;p=p+1;*p+a[0];'
+testf 720 'int g(int a,int b,int c,int d,int e,int f){int s=1;for(int i=0;i<1;i++){s=a*b*c*d*e*f;}s;} int f(){g(1,2,3,4,5,6);}'
+
+# Scaled index
+test 14 'int a[3][4];for(int i=0;i<3;i++){for(int j=0;j<4;j++){a[i][j]=i*j;}}a[2][3]+a[1][2]+a[2][2]+a[2][1];'
+test 11 'int a[4]={1,2,3,4};int i=3;int *p=a+1;a[i]+p[i-1]+*(p+i-3)+*(p-1);'
+test 'hfllo 4' 'char s[6]="hello";int i=1;s[i]++;printf("%s ",s);int a[2][2];int *p=a;p[3]=4;a[1][1];'
+testf 7 'int g[2][3]; int f(){int i=1;int j=2;g[i][j]=7;g[1][2];}'
+testf 6 'int h(int *p,int i){p[i]=p[i-1]+p[i+1];} int f(){int a[3]={1,0,5};h(a,1);a[1];}'
+
+# Strength reduction
+test '0 7 56 21 49' 'int x=7;printf("%d %d %d %d ",x*0,1*x,x*8,x*3);x*7;'
+test '35 63 105 280' 'int x=7;printf("%d %d %d ",5*x,x*9,x*15);x*40;'
+test '-3 -1 -1 -1' 'int a=0-7;int b=0-13;int c=a/2;int d=a/4;int e=b/7;printf("%d %d %d ",c,d,e);b/10;'
+test '-2 3 2' 'int a=0-16;int b=0-13;int c=a/8;int d=10/3;printf("%d %d ",c,d);b/(0-5);'
+test 12 'int a[4][3];int i=3;int j=2;a[i][j]=12;int *p=a;p[11];'
+
+# Compare and branch
+test 21 'int a=3;int b=0;if(a<5){b=b+1;}if(a>5){b=b+2;}if(a==3){b=b+4;}if(!(a==3)){b=b+8;}if(!!(2<a)){b=b+16;}b;'
+test 6 'int a=1;int b=0;if(!a){b=1;}else{b=2;}if(!!a){b=b+4;}if(0){b=b+8;}b;'
+test 10 'int s=0;for(int i=0;!(i==4);i++){s=s+i;}int *p=&s;for(;!(*p>9);){s++;}s;'
+test 3 'char c=3;int n=0;for(int i=0;i<c;i++){n++;}n;'
+
+# Loop rotation and invariant code motion
+test 9 'int n=3;int s=0;for(int i=0;i<n*n;i++){s=s+n*2;}s/6;'
+test 5 'int n=0;int s=5;for(int i=0;i<n;i++){s=s+n*n;}s;'
+test 30 'int a[3][4];int s=0;for(int i=0;i<3;i++){for(int j=0;j<4;j++){a[i][j]=i+j;}}for(int i=0;i<3;i++){for(int j=0;j<4;j++){s=s+a[i][j];}}s;'
+test 13 'int k=1;int *p=&k;int s=0;for(int i=0;i<3;i++){s=s+k*2;*p=k+1;}s+k-3;'
+test 14 'int n=2;int s=0;for(int i=0;i<4;i++){s=s+n+1;if(i==1){n=3;}}s;'
+test 6 'int s=0;for(int i=0;i<3;i++){int m=i*2;s=s+m;}s;'
+
+# Loop unrolling
+test 28 'int a[8];int s=0;for(int i=0;i<8;i++){a[i]=i;}for(int i=0;i<8;i++){s=s+a[i];}s;'
+test '4950 0' 'int s=0;for(int i=0;i<100;i++){s=s+i;}printf("%d ",s);0;'
+test 10 'int s=0;int i;for(i=1;i<37;i=i+4){s=s+1;}s+i-36;'
+test 55 'int s=0;int i;for(i=10;i>0;i--){s=s+i;}s+i;'
+test 7 'int s=7;for(int i=5;i<5;i++){s=s+1;}s;'
+test 42 'int a[6][7];int s=0;for(int i=0;i<6;i++){for(int j=0;j<7;j++){a[i][j]=1;}}for(int i=0;i<6;i++){for(int j=0;j<7;j++){s=s+a[i][j];}}s;'
+test 3 'int n=0;for(int i=0;i<3;i++){int t=n;n=t+1;}n;'
+
+# Leaf functions
+testf 7 'int g(int a,int b){a+b;} int f(){g(3,4);}'
+testf 15 'int g(int a,int b,int c,int d,int e){a+b+c+d+e;} int f(){g(1,2,3,4,5);}'
+testf 8 'int g(char c,int *p){*p+c;} int f(){int x=5;g(3,&x);}'
+testf 7 'int g(int n){int a[3];for(int i=0;i<3;i++){a[i]=n+i;}a[2]+a[1];} int f(){g(2);}'
+testf 63 'int g(int a,int b,int c){(a+b)*(b+c)+(a+c)*(a*b+(c-a)*(b+a*c));} int f(){g(1,2,3);}'
+
+# Frame layout
+test 12 'int s=0;{int a=5;s=s+a;}{int b=7;s=s+b;}s;'
+test 6 'char a=1;int b=2;char c=3;char *p=&c;*p+a+b;'
+test 9 'int a=4;{int b=5;int *p=&b;a=a+*p;}a;'
+test 10 'char s[3]="ab";int n=0;for(int i=0;i<2;i++){char t[2]="x";int k=i+1;n=n+k;}{int m[2]={3,4};n=n+m[0]+m[1];}n;'
+testf 7 'int g(char a,int b){char c=a;int *p=&b;{char d[3];d[2]=c;*p=*p+d[2];}b;} int f(){g(3,4);}'
+
+# Array initialization
+test 3 'int a[5]={1,2};a[0]+a[1]+a[2]+a[3]+a[4];'
+test 'ab 0' 'char s[8]="ab";printf("%s ",s);s[5];'
+test 7 'int t[100]={7,1,2};int s=0;for(int i=0;i<100;i++){s=s+t[i];}s-3;'
+test 101 'char t[300]="hello";t[1]+t[299];'
+test 6 'char c[20]={1,2,3};int s=0;for(int i=0;i<20;i++){s=s+c[i];}s;'
+test 18 'int s=0;for(int i=0;i<3;i++){int a[3]={1,2,3};s=s+a[i]*3;}s;'
+test 9 'int x=4;int a[4]={x,x+1};a[0]+a[1]+a[2]+a[3];'
+testf 124 'int g(int a,int b){char t[300]="xy";t[1]+a+b+t[200];} int f(){g(1,2);}'
+
+# Function inlining
+testf 14 'int g(int a){return a*2;} int f(){g(3)+g(4);}'
+testf 14 'int g(int a){a+1;} int h(int a,int b){int t=a+b;t*g(a);} int f(){int s=0;for(int i=0;i<3;i++){s=s+h(i,1);}s;}'
+testf 8 'int g(int a){a=a+2;a;} int f(){int x=3;int y=g(x);x+y;}'
+testf 2 'int g(int a){a==3;} int f(){int r=0;if(g(3)){r=2;}r;}'
+testf 4 'int g(char c){c;} int f(){g(260);}'
+testf 16 'int g(int *p){int t[2]={1,2};*p=*p+t[1];*p;} int f(){int x=4;g(&x);int y=g(&x);y+x;}'
+testf 9 'int g(int a){a+1;} int f(){g(g(g(6)));}'
+testf 3 'int g(int a){a<3;} int f(){int n=0;for(int i=0;g(i);i++){n++;}n;}'
+testf 7 'int *g(int *a){return a;} int f(){int x[2]; x[1]=7; int *p=g(x); return *(p+1);}'
+
+# Tail calls
+testf 5050 'int sum(int n,int acc){if(n==0){return acc;}return sum(n-1,acc+n);} int f(){sum(100,0);}'
+testf 55 'int fib(int n,int a,int b){if(n==0){return a;}fib(n-1,b,a+b);} int f(){fib(10,0,1);}'
+testf 12 'int gcd(int a,int b){if(b==0){return a;}return gcd(b,a-a/b*b);} int f(){gcd(84,36);}'
+testf 4 'int g(char c,int n){if(n==0){return c;}return g(c+1,n-1);} int f(){g(250,10);}'
+testf 10 'int g(int *p,int n){if(n==0){return *p;}*p=*p+n;return g(p,n-1);} int f(){int x=0;g(&x,4);}'
+testf 'x5 3' 'int g(int a){if(a==0){return 0;}printf("x%d ",a);} int f(){g(5);3;}'
+
+# SSA
+test 7 'int a=1;int b;if(a){b=7;}else{b=9;}b;'
+test 55 'int a=0;int b=1;for(int i=0;i<10;i++){int t=a+b;a=b;b=t;}a;'
+test 3 'int a=3;for(;0;){a=4;}a;'
+testf 6 'int g(int n){if(n<2){return 1;}n*g(n-1);} int f(){g(3);}'
+
+# Options
+echo 'int f(){1;}' | ./qcc -fverbose-asm | grep -q '# [0-9]*$' || { echo "Test failed: -fverbose-asm"; exit; }
+echo 'int f(){1;}' | ./qcc | grep -q '#' && { echo "Test failed: unexpected annotation"; exit; }
+echo "int f(){char *s=\"$long\";1;}" | ./qcc -fverbose-asm -fpeephole | grep -q "$long\"  *# [0-9]*$" || { echo "Test failed: -fverbose-asm long line"; exit; }
+echo 'int f(){1;}' | ./qcc -fbogus > /dev/null 2>&1 && { echo "Should fail on unknown flag -fbogus"; exit; }
+echo 'int f(){int s=0;for(int i=0;i<3;i++){s=s+i;}s;}' | ./qcc -fdump-ir 2>&1 >/dev/null | grep -q 'phi' || { echo "Test failed: -fdump-ir"; exit; }
+echo 'int f(){int a=1;int b=2;a+b;}' | ./qcc -fpeephole | grep -q 'push %rax' && { echo "Test failed: -fpeephole push/pop"; exit; }
+echo 'int f(){int a=1;int b=2;a+b;}' | ./qcc -fpeephole -fpeephole-report 2>&1 >/dev/null | grep -q 'push-pop *: [1-9]' || { echo "Test failed: -fpeephole-report"; exit; }
+echo 'int f(int x){x/7;}' | ./qcc -O1 | grep -q 'idiv' && { echo "Test failed: -fstrength-reduce idiv"; exit; }
+echo 'int f(int x){if(x<3){1;}0;}' | ./qcc -O1 | grep -q 'setl' && { echo "Test failed: -fcompare-branch setl"; exit; }
+echo 'int f(){int s=0;for(int i=0;i<4;i++){s=s+i;}s;}' | ./qcc -O2 | grep -q 'jl' && { echo "Test failed: -funroll-loops"; exit; }
+echo 'int f(){int s=0;for(int i=0;i<4;i++){s=s+i;}s;}' | ./qcc -O2 -funroll-factor=1 | grep -q 'jl' || { echo "Test failed: -funroll-factor=1"; exit; }
+echo 'int g(int a){a;} int f(int x){g(x+1);}' | ./qcc -O1 | grep -q 'push %rdi' && { echo "Test failed: -fcall-args saved rdi"; exit; }
+echo 'int g(int a,int b){a+b;}' | ./qcc -O1 | grep -q 'push %rbp' && { echo "Test failed: -fomit-leaf-frame"; exit; }
+echo 'int f(){char a=1;char b=2;a+b;}' | ./qcc -fpack-frame | grep -q -- '-2(%rbp)' || { echo "Test failed: -fpack-frame"; exit; }
+echo 'int f(){int t[100]={1};t[0];}' | ./qcc -O1 | grep -q 'rep stosb' || { echo "Test failed: -fbulk-init"; exit; }
+echo 'int g(int a){a*2;} int f(int x){g(x);}' | ./qcc -O2 | grep -q 'call g' && { echo "Test failed: -finline-functions"; exit; }
+echo 'int g(int a){a*2;} int f(int x){g(x)+1;}' | ./qcc -O2 -finline-limit=0 | grep -q 'call g' || { echo "Test failed: -finline-limit=0"; exit; }
+echo 'int c(int n){if(n==0){return 0;}return c(n-1);}' | ./qcc -O2 | grep -q 'call c' && { echo "Test failed: -foptimize-sibling-calls"; exit; }
+echo "[*] success on options"
 
 echo "All tests passed"
 make clean
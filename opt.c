@@ -0,0 +1,947 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 18:42:10
+ * @LastEditTime: 2026-10-17 18:42:10
+ * @LastEditors: QQYYHH
+ * @Description: 抽象语法树上的优化
+ * @FilePath: /pwn/qcc/opt.c
+ * welcome to my github: https://github.com/QQYYHH
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "qcc.h"
+
+/**
+ * 循环不变量外提（-flicm）
+ * for 循环的条件、步进和循环体中，只依赖循环内没有被赋值的变量的纯计算，比如 n*n、二维数组的行地址 a[i]，
+ * 在每次迭代中的值都相同，把它们提到 forinit 的后面计算一次，保存在新的局部变量中
+ *
+ * 只外提不会出错也没有副作用的运算：+ - * < > == ! 以及不访存的数组取下标，
+ * 即使循环一次也不执行，提前计算也不会改变程序的行为
+ * 被取了地址的变量可能通过指针被修改，全局变量可能被调用的函数修改，都不认为是不变的
+ */
+
+// 当前函数，新的局部变量要加入它的 locals
+static Ast *cur_func;
+// 当前函数中被取了地址的局部变量
+static Vector *addr_taken;
+// 当前循环中被赋值的局部变量
+static Vector *assigned;
+// 当前循环外提出来的表达式，与保存它的局部变量一一对应
+static Vector *hoisted;
+static Vector *temps;
+
+static bool contains(Vector *vars, Ast *var)
+{
+    for (int i = 0; i < vec_len(vars); i++)
+        if (vec_get(vars, i) == var)
+            return true;
+    return false;
+}
+
+static void add_var(Vector *vars, Ast *var)
+{
+    if (vars && !contains(vars, var))
+        vec_push(vars, var);
+}
+
+/**
+ * @brief 收集 ast 中被赋值和被取了地址的局部变量
+ * 在循环体中声明的变量每次迭代都会重新初始化，也算作被赋值
+ */
+static void collect_vars(Ast *ast, Vector *set, Vector *taken)
+{
+    if (!ast)
+        return;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return;
+    case AST_ADDR:
+        if (ast->operand->type == AST_LVAR)
+        {
+            add_var(taken, ast->operand);
+            return;
+        }
+        collect_vars(ast->operand, set, taken);
+        return;
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        if (ast->operand->type == AST_LVAR)
+            add_var(set, ast->operand);
+        collect_vars(ast->operand, set, taken);
+        return;
+    case AST_DEREF:
+    case '!':
+        collect_vars(ast->operand, set, taken);
+        return;
+    case AST_FUNCALL:
+        for (int i = 0; i < vec_len(ast->args); i++)
+            collect_vars(vec_get(ast->args, i), set, taken);
+        return;
+    case AST_DECL:
+        add_var(set, ast->decl_var);
+        if (ast->decl_init && ast->decl_init->type == AST_ARRAY_INIT)
+            for (int i = 0; i < vec_len(ast->decl_init->array_init); i++)
+                collect_vars(vec_get(ast->decl_init->array_init, i), set, taken);
+        else
+            collect_vars(ast->decl_init, set, taken);
+        return;
+    case AST_IF:
+        collect_vars(ast->cond, set, taken);
+        collect_vars(ast->then, set, taken);
+        collect_vars(ast->els, set, taken);
+        return;
+    case AST_FOR:
+        collect_vars(ast->forinit, set, taken);
+        collect_vars(ast->forcond, set, taken);
+        collect_vars(ast->forstep, set, taken);
+        collect_vars(ast->forbody, set, taken);
+        return;
+    case AST_RET:
+        collect_vars(ast->retval, set, taken);
+        return;
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            collect_vars(vec_get(ast->stmts, i), set, taken);
+        return;
+    case '=':
+        if (ast->left->type == AST_LVAR)
+            add_var(set, ast->left);
+        // fallthrough
+    default:
+        collect_vars(ast->left, set, taken);
+        collect_vars(ast->right, set, taken);
+    }
+}
+
+// 表达式的值在当前循环的每次迭代中都相同，并且计算时不会出错
+static bool is_invariant(Ast *ast)
+{
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+        return true;
+    case AST_LVAR:
+        // 数组变量的值是它的地址
+        return ast->ctype->type == CTYPE_ARRAY ||
+               (!contains(assigned, ast) && !contains(addr_taken, ast));
+    case AST_GVAR:
+        return ast->ctype->type == CTYPE_ARRAY;
+    case AST_DEREF:
+        // 结果是数组时只计算地址，不访存
+        return ast->ctype->type == CTYPE_ARRAY && is_invariant(ast->operand);
+    case '!':
+        return is_invariant(ast->operand);
+    case '+':
+    case '-':
+    case '*':
+    case '<':
+    case '>':
+    case PUNCT_EQ:
+        return is_invariant(ast->left) && is_invariant(ast->right);
+    default:
+        return false;
+    }
+}
+
+// 结构相同的两个表达式，值也相同
+static bool same_expr(Ast *a, Ast *b)
+{
+    if (a->type != b->type || a->ctype != b->ctype)
+        return false;
+    switch (a->type)
+    {
+    case AST_LITERAL:
+        return a->ctype->type == CTYPE_CHAR ? a->c == b->c : a->ival == b->ival;
+    case AST_LVAR:
+    case AST_GVAR:
+        return a == b;
+    case AST_DEREF:
+    case '!':
+        return same_expr(a->operand, b->operand);
+    default:
+        return same_expr(a->left, b->left) && same_expr(a->right, b->right);
+    }
+}
+
+// 保存外提表达式的局部变量，相同的表达式共用一个变量
+static Ast *hoist_temp(Ast *expr)
+{
+    for (int i = 0; i < vec_len(hoisted); i++)
+        if (same_expr(vec_get(hoisted, i), expr))
+            return vec_get(temps, i);
+    Ast *var = qalloc(sizeof(Ast));
+    var->type = AST_LVAR;
+    var->ctype = expr->ctype;
+    var->lname = "licm";
+    var->lreg = NULL;
+    var->luses = 0;
+    vec_push(cur_func->locals, var);
+    vec_push(hoisted, expr);
+    vec_push(temps, var);
+    return var;
+}
+
+/**
+ * @brief 把 *p 中最大的不变子表达式替换成局部变量
+ * 只外提真正需要计算的整数和指针运算，字面量和变量本身不需要外提
+ */
+static void hoist(Ast **p)
+{
+    Ast *ast = *p;
+    if (!ast)
+        return;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return;
+    case '!':
+    case '+':
+    case '-':
+    case '*':
+    case '<':
+    case '>':
+    case PUNCT_EQ:
+        if ((ast->ctype->type == CTYPE_INT || ast->ctype->type == CTYPE_PTR) && is_invariant(ast))
+        {
+            *p = hoist_temp(ast);
+            return;
+        }
+        break;
+    }
+    switch (ast->type)
+    {
+    case AST_ADDR:
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        hoist(&ast->operand);
+        return;
+    case AST_FUNCALL:
+        for (int i = 0; i < vec_len(ast->args); i++)
+            hoist((Ast **)&ast->args->body[i]);
+        return;
+    case AST_DECL:
+        if (ast->decl_init && ast->decl_init->type == AST_ARRAY_INIT)
+            for (int i = 0; i < vec_len(ast->decl_init->array_init); i++)
+                hoist((Ast **)&ast->decl_init->array_init->body[i]);
+        else
+            hoist(&ast->decl_init);
+        return;
+    case AST_IF:
+        hoist(&ast->cond);
+        hoist(&ast->then);
+        hoist(&ast->els);
+        return;
+    case AST_FOR:
+        hoist(&ast->forinit);
+        hoist(&ast->forcond);
+        hoist(&ast->forstep);
+        hoist(&ast->forbody);
+        return;
+    case AST_RET:
+        hoist(&ast->retval);
+        return;
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            hoist((Ast **)&ast->stmts->body[i]);
+        return;
+    case '=':
+        // 被赋值的变量不能替换
+        if (ast->left->type != AST_LVAR)
+            hoist(&ast->left);
+        hoist(&ast->right);
+        return;
+    default:
+        hoist(&ast->left);
+        hoist(&ast->right);
+    }
+}
+
+/**
+ * @brief 外提一个 for 循环中的不变量
+ * forinit 变成 { forinit; t1 = e1; t2 = e2; ... }
+ */
+static void licm_loop(Ast *loop)
+{
+    assigned = make_vector();
+    hoisted = make_vector();
+    temps = make_vector();
+    collect_vars(loop->forcond, assigned, NULL);
+    collect_vars(loop->forstep, assigned, NULL);
+    collect_vars(loop->forbody, assigned, NULL);
+    hoist(&loop->forcond);
+    hoist(&loop->forstep);
+    hoist(&loop->forbody);
+    if (!vec_len(hoisted))
+        return;
+    Vector *stmts = make_vector();
+    if (loop->forinit)
+        vec_push(stmts, loop->forinit);
+    for (int i = 0; i < vec_len(hoisted); i++)
+    {
+        Ast *assign = qalloc(sizeof(Ast));
+        assign->type = '=';
+        assign->left = vec_get(temps, i);
+        assign->right = vec_get(hoisted, i);
+        assign->ctype = assign->left->ctype;
+        vec_push(stmts, assign);
+    }
+    Ast *init = qalloc(sizeof(Ast));
+    init->type = AST_COMPOUND_STMT;
+    init->ctype = NULL;
+    init->stmts = stmts;
+    loop->forinit = init;
+}
+
+// 先处理外层循环，外层提不出去的再由内层循环外提到内层循环的前面
+static void licm_stmt(Ast *ast)
+{
+    if (!ast)
+        return;
+    switch (ast->type)
+    {
+    case AST_IF:
+        licm_stmt(ast->then);
+        licm_stmt(ast->els);
+        return;
+    case AST_FOR:
+        licm_loop(ast);
+        licm_stmt(ast->forbody);
+        return;
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            licm_stmt(vec_get(ast->stmts, i));
+        return;
+    }
+}
+
+/**
+ * 循环展开（-funroll-loops）
+ * 识别次数在编译时已知的计数循环：
+ *     for (int i = a; i < b; i = i + c)  或者  for (i = a; i > b; i = i - c)
+ * 其中 a b c 都是字面量，i 在循环中没有被赋值也没有被取地址
+ *
+ * 次数少、循环体小的循环完全展开，每份循环体中的 i 替换成字面量
+ * 其它循环按照 -funroll-factor 部分展开，循环体复制 factor 份，
+ * 第k份中的 i 替换成 i + k*c，每轮迭代只更新一次 i；剩下不足 factor 次的迭代在循环后面完全展开
+ */
+
+// 完全展开后的代码，或者部分展开后的一轮迭代，大约不超过 factor 个这么大的循环体
+#define UNROLL_NODES 32
+
+int unroll_factor = 4;
+
+static Ast *make_literal(int val)
+{
+    Ast *r = qalloc(sizeof(Ast));
+    r->type = AST_LITERAL;
+    r->ctype = ctype_int;
+    r->ival = val;
+    return r;
+}
+
+static Ast *make_assign(Ast *var, Ast *val)
+{
+    Ast *r = qalloc(sizeof(Ast));
+    r->type = '=';
+    r->ctype = var->ctype;
+    r->left = var;
+    r->right = val;
+    return r;
+}
+
+static Ast *make_compound(Vector *stmts)
+{
+    Ast *r = qalloc(sizeof(Ast));
+    r->type = AST_COMPOUND_STMT;
+    r->ctype = NULL;
+    r->stmts = stmts;
+    return r;
+}
+
+// 抽象语法树的节点数，用来估计代码的大小
+static int count_nodes(Ast *ast)
+{
+    if (!ast)
+        return 0;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return 1;
+    case AST_ADDR:
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        return 1 + count_nodes(ast->operand);
+    case AST_FUNCALL:
+    {
+        int n = 2;
+        for (int i = 0; i < vec_len(ast->args); i++)
+            n += count_nodes(vec_get(ast->args, i));
+        return n;
+    }
+    case AST_DECL:
+        return 1 + count_nodes(ast->decl_init);
+    case AST_ARRAY_INIT:
+    {
+        int n = 1;
+        for (int i = 0; i < vec_len(ast->array_init); i++)
+            n += count_nodes(vec_get(ast->array_init, i));
+        return n;
+    }
+    case AST_IF:
+        return 1 + count_nodes(ast->cond) + count_nodes(ast->then) + count_nodes(ast->els);
+    case AST_FOR:
+        return 1 + count_nodes(ast->forinit) + count_nodes(ast->forcond) +
+               count_nodes(ast->forstep) + count_nodes(ast->forbody);
+    case AST_RET:
+        return 1 + count_nodes(ast->retval);
+    case AST_COMPOUND_STMT:
+    {
+        int n = 0;
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            n += count_nodes(vec_get(ast->stmts, i));
+        return n;
+    }
+    default:
+        return 1 + count_nodes(ast->left) + count_nodes(ast->right);
+    }
+}
+
+static Ast *copy_ast(Ast *ast, Vector *from, Vector *to);
+
+static Vector *copy_vector(Vector *v, Vector *from, Vector *to)
+{
+    Vector *r = make_vector();
+    for (int i = 0; i < vec_len(v); i++)
+        vec_push(r, copy_ast(vec_get(v, i), from, to));
+    return r;
+}
+
+/**
+ * @brief 复制一份抽象语法树，其中出现 from 中变量的地方替换成 to 中对应节点的副本
+ * 变量和字符串常量不需要复制，字面量要复制，内联的函数体复制到 perm_arena 中之后不能引用原来的节点
+ */
+static Ast *copy_ast(Ast *ast, Vector *from, Vector *to)
+{
+    if (!ast)
+        return NULL;
+    for (int i = 0; from && i < vec_len(from); i++)
+        if (vec_get(from, i) == ast)
+            return copy_ast(vec_get(to, i), NULL, NULL);
+    switch (ast->type)
+    {
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return ast;
+    }
+    Ast *r = qalloc(sizeof(Ast));
+    *r = *ast;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+        break;
+    case AST_ADDR:
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        r->operand = copy_ast(ast->operand, from, to);
+        break;
+    case AST_FUNCALL:
+        r->args = copy_vector(ast->args, from, to);
+        break;
+    case AST_DECL:
+        r->decl_var = copy_ast(ast->decl_var, from, to);
+        r->decl_init = copy_ast(ast->decl_init, from, to);
+        break;
+    case AST_ARRAY_INIT:
+        r->array_init = copy_vector(ast->array_init, from, to);
+        break;
+    case AST_IF:
+        r->cond = copy_ast(ast->cond, from, to);
+        r->then = copy_ast(ast->then, from, to);
+        r->els = copy_ast(ast->els, from, to);
+        break;
+    case AST_FOR:
+        r->forinit = copy_ast(ast->forinit, from, to);
+        r->forcond = copy_ast(ast->forcond, from, to);
+        r->forstep = copy_ast(ast->forstep, from, to);
+        r->forbody = copy_ast(ast->forbody, from, to);
+        break;
+    case AST_RET:
+        r->retval = copy_ast(ast->retval, from, to);
+        break;
+    case AST_COMPOUND_STMT:
+        r->stmts = copy_vector(ast->stmts, from, to);
+        break;
+    default:
+        r->left = copy_ast(ast->left, from, to);
+        r->right = copy_ast(ast->right, from, to);
+    }
+    return r;
+}
+
+static bool is_int_literal(Ast *ast)
+{
+    return ast->type == AST_LITERAL && ast->ctype->type == CTYPE_INT;
+}
+
+// 计数循环，step 是每次迭代 i 的增量
+typedef struct
+{
+    Ast *var;
+    int init;
+    int step;
+    int trips;
+} Counter;
+
+// 字面量的范围足够小，计算迭代次数和 i 的值都不会溢出
+#define COUNTER_LIMIT (1 << 24)
+
+/**
+ * @brief 识别计数循环，计算迭代次数
+ */
+static bool match_counter(Ast *loop, Counter *c)
+{
+    Ast *init = loop->forinit, *cond = loop->forcond, *step = loop->forstep;
+    if (!init || !cond || !step)
+        return false;
+    Ast *var, *val;
+    if (init->type == AST_DECL && init->decl_init)
+    {
+        var = init->decl_var;
+        val = init->decl_init;
+    }
+    else if (init->type == '=' && init->left->type == AST_LVAR)
+    {
+        var = init->left;
+        val = init->right;
+    }
+    else
+        return false;
+    if (var->ctype->type != CTYPE_INT || !is_int_literal(val) || contains(addr_taken, var))
+        return false;
+    if ((cond->type != '<' && cond->type != '>') || cond->left != var || !is_int_literal(cond->right))
+        return false;
+    // i++, i--, i = i + c, i = i - c
+    int d;
+    if (step->type == PUNCT_INC && step->operand == var)
+        d = 1;
+    else if (step->type == PUNCT_DEC && step->operand == var)
+        d = -1;
+    else if (step->type == '=' && step->left == var &&
+             (step->right->type == '+' || step->right->type == '-') &&
+             step->right->left == var && is_int_literal(step->right->right))
+        d = step->right->type == '+' ? step->right->right->ival : 0 - step->right->right->ival;
+    else
+        return false;
+    int from = val->ival, to = cond->right->ival;
+    if (from > COUNTER_LIMIT || from < 0 - COUNTER_LIMIT || to > COUNTER_LIMIT || to < 0 - COUNTER_LIMIT ||
+        d > COUNTER_LIMIT || d < 0 - COUNTER_LIMIT)
+        return false;
+    // 条件的方向与增量的方向一致，循环才会结束
+    if ((cond->type == '<') != (d > 0))
+        return false;
+    Vector *set = make_vector();
+    collect_vars(loop->forbody, set, NULL);
+    if (contains(set, var))
+        return false;
+    c->var = var;
+    c->init = from;
+    c->step = d;
+    if (d > 0)
+        c->trips = to > from ? (to - from + d - 1) / d : 0;
+    else
+        c->trips = from > to ? (from - to - d - 1) / (0 - d) : 0;
+    return true;
+}
+
+// i 的值为 base + k*step 时的第k份循环体
+static Ast *body_copy(Ast *loop, Counter *c, Ast *base, int k)
+{
+    Ast *val = base;
+    if (!base)
+        val = make_literal(c->init + k * c->step);
+    else if (k)
+    {
+        val = qalloc(sizeof(Ast));
+        val->type = '+';
+        val->ctype = ctype_int;
+        val->left = base;
+        val->right = make_literal(k * c->step);
+    }
+    Vector *from = make_vector(), *to = make_vector();
+    vec_push(from, c->var);
+    vec_push(to, val);
+    return copy_ast(loop->forbody, from, to);
+}
+
+/**
+ * @brief 展开一个计数循环，返回替换它的语句，不展开时返回NULL
+ */
+static Ast *unroll_loop(Ast *loop)
+{
+    Counter c;
+    if (unroll_factor < 2 || !match_counter(loop, &c))
+        return NULL;
+    int size = count_nodes(loop->forbody) + 1;
+    Vector *stmts = make_vector();
+    vec_push(stmts, loop->forinit);
+    // 在 forinit 中声明的 i 在循环之后不可见，不需要最后的赋值
+    bool live_out = loop->forinit->type != AST_DECL;
+    if ((long)c.trips * size <= unroll_factor * UNROLL_NODES)
+    {
+        for (int k = 0; k < c.trips; k++)
+            vec_push(stmts, body_copy(loop, &c, NULL, k));
+        if (live_out)
+            vec_push(stmts, make_assign(c.var, make_literal(c.init + c.trips * c.step)));
+        return make_compound(stmts);
+    }
+    int f = unroll_factor;
+    if (size > UNROLL_NODES || c.trips < 2 * f)
+        return NULL;
+    // 主循环执行 trips/f 轮，每轮 f 份循环体
+    int main_trips = c.trips / f * f;
+    Vector *body = make_vector();
+    for (int k = 0; k < f; k++)
+        vec_push(body, body_copy(loop, &c, c.var, k));
+    Ast *inc = qalloc(sizeof(Ast));
+    inc->type = '+';
+    inc->ctype = ctype_int;
+    inc->left = c.var;
+    inc->right = make_literal(f * c.step);
+    Ast *cond = qalloc(sizeof(Ast));
+    *cond = *loop->forcond;
+    cond->right = make_literal(c.init + main_trips * c.step);
+    Ast *main_loop = qalloc(sizeof(Ast));
+    *main_loop = *loop;
+    main_loop->forinit = NULL;
+    main_loop->forcond = cond;
+    main_loop->forstep = make_assign(c.var, inc);
+    main_loop->forbody = make_compound(body);
+    vec_push(stmts, main_loop);
+    // 剩下的迭代中 i 的值也已知
+    for (int k = main_trips; k < c.trips; k++)
+        vec_push(stmts, body_copy(loop, &c, NULL, k));
+    if (live_out)
+        vec_push(stmts, make_assign(c.var, make_literal(c.init + c.trips * c.step)));
+    return make_compound(stmts);
+}
+
+// 先展开内层循环，再看外层循环
+static void unroll_stmt(Ast **p)
+{
+    Ast *ast = *p;
+    if (!ast)
+        return;
+    switch (ast->type)
+    {
+    case AST_IF:
+        unroll_stmt(&ast->then);
+        unroll_stmt(&ast->els);
+        return;
+    case AST_FOR:
+    {
+        unroll_stmt(&ast->forbody);
+        Ast *r = unroll_loop(ast);
+        if (r)
+            *p = r;
+        return;
+    }
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            unroll_stmt((Ast **)&ast->stmts->body[i]);
+        return;
+    }
+}
+
+/**
+ * 函数内联（-finline-functions）
+ * 函数逐个生成代码，只能内联在调用者之前定义的函数
+ * 函数体足够小（不超过 -finline-limit 个节点）、只在最后一条语句返回、并且最后一条语句是表达式的函数可以内联，
+ * 它的函数体复制一份到 perm_arena 中，在后面的函数生成代码时使用
+ *
+ * 没有 && || ?: 这样按条件求值的运算，表达式中的每个子表达式都会被求值，
+ * 因此可以把表达式中的调用提到所在语句的前面：
+ *     s = s + g(x);
+ * 变成
+ *     int a = x; int t; { g的函数体，最后一条语句 e 换成 t = e; } s = s + t;
+ * 参数和函数体中的局部变量都换成调用者中新的局部变量
+ * for 的条件和步进每次迭代都要求值，其中的调用不内联
+ */
+
+int inline_limit = 40;
+
+// 可以内联的函数
+static Vector *inline_funcs = EMPTY_VECTOR;
+
+static Ast *make_var(Ctype *ctype, char *name)
+{
+    Ast *r = qalloc(sizeof(Ast));
+    r->type = AST_LVAR;
+    r->ctype = ctype;
+    r->lname = name;
+    r->lreg = NULL;
+    r->luses = 0;
+    return r;
+}
+
+static Ast *make_decl(Ast *var, Ast *init)
+{
+    Ast *r = qalloc(sizeof(Ast));
+    r->type = AST_DECL;
+    r->ctype = NULL;
+    r->decl_var = var;
+    r->decl_init = init;
+    return r;
+}
+
+// 最后一条语句之外是否还有 return
+static bool has_return(Ast *ast)
+{
+    if (!ast)
+        return false;
+    switch (ast->type)
+    {
+    case AST_RET:
+        return true;
+    case AST_IF:
+        return has_return(ast->then) || has_return(ast->els);
+    case AST_FOR:
+        return has_return(ast->forbody);
+    case AST_COMPOUND_STMT:
+        for (int i = 0; i < vec_len(ast->stmts); i++)
+            if (has_return(vec_get(ast->stmts, i)))
+                return true;
+        return false;
+    default:
+        return false;
+    }
+}
+
+static bool is_expr(Ast *ast)
+{
+    switch (ast->type)
+    {
+    case AST_DECL:
+    case AST_IF:
+    case AST_FOR:
+    case AST_RET:
+    case AST_COMPOUND_STMT:
+        return false;
+    default:
+        return true;
+    }
+}
+
+// 最后一条语句的值就是函数的返回值
+static Ast *result_expr(Ast *func)
+{
+    Ast *last = vec_get(func->body->stmts, vec_len(func->body->stmts) - 1);
+    return last->type == AST_RET ? last->retval : last;
+}
+
+static bool can_inline(Ast *func)
+{
+    Vector *stmts = func->body->stmts;
+    if (!vec_len(stmts) || count_nodes(func->body) > inline_limit)
+        return false;
+    for (int i = 0; i < vec_len(stmts) - 1; i++)
+        if (has_return(vec_get(stmts, i)))
+            return false;
+    Ast *r = result_expr(func);
+    // 调用表达式的类型总是 int，结果放进 int 临时变量会截断指针
+    return r && is_expr(r) && (r->ctype->type == CTYPE_INT || r->ctype->type == CTYPE_CHAR);
+}
+
+/**
+ * @brief 复制 func 的参数、局部变量和函数体，参数和局部变量都换成新的变量
+ * @param locals 新的局部变量加入这里
+ */
+static Ast *copy_func(Ast *func, Vector *locals)
+{
+    Vector *from = make_vector(), *to = make_vector();
+    Ast *r = qalloc(sizeof(Ast));
+    *r = *func;
+    r->params = make_vector();
+    r->locals = make_vector();
+    for (int i = 0; i < vec_len(func->params) + vec_len(func->locals); i++)
+    {
+        bool param = i < vec_len(func->params);
+        Ast *var = param ? vec_get(func->params, i) : vec_get(func->locals, i - vec_len(func->params));
+        Ast *v = make_var(var->ctype, var->lname);
+        vec_push(from, var);
+        vec_push(to, v);
+        vec_push(param ? r->params : r->locals, v);
+        vec_push(locals, v);
+    }
+    r->body = copy_ast(func->body, from, to);
+    return r;
+}
+
+// 函数生成代码之前记录下来，后面定义的函数可以内联它
+static void add_inline_func(Ast *func)
+{
+    if (!can_inline(func))
+        return;
+    Arena *saved = cur_arena;
+    cur_arena = perm_arena;
+    Vector *locals = make_vector();
+    vec_push(inline_funcs, copy_func(func, locals));
+    cur_arena = saved;
+}
+
+static Ast *find_inline_func(Ast *call)
+{
+    for (int i = 0; i < vec_len(inline_funcs); i++)
+    {
+        Ast *func = vec_get(inline_funcs, i);
+        if (!strcmp(func->fname, call->fname))
+            return vec_len(func->params) == vec_len(call->args) ? func : NULL;
+    }
+    return NULL;
+}
+
+/**
+ * @brief 把 *p 中可以内联的调用展开成 out 中的语句，调用本身换成保存结果的变量
+ * 先处理参数中的调用，保证它们在外层调用之前求值
+ */
+static void inline_calls(Ast **p, Vector *out)
+{
+    Ast *ast = *p;
+    if (!ast)
+        return;
+    switch (ast->type)
+    {
+    case AST_LITERAL:
+    case AST_STRING:
+    case AST_LVAR:
+    case AST_GVAR:
+        return;
+    case AST_ADDR:
+    case AST_DEREF:
+    case '!':
+    case PUNCT_INC:
+    case PUNCT_DEC:
+        inline_calls(&ast->operand, out);
+        return;
+    case AST_ARRAY_INIT:
+        for (int i = 0; i < vec_len(ast->array_init); i++)
+            inline_calls((Ast **)&ast->array_init->body[i], out);
+        return;
+    case AST_FUNCALL:
+    {
+        for (int i = 0; i < vec_len(ast->args); i++)
+            inline_calls((Ast **)&ast->args->body[i], out);
+        Ast *func = find_inline_func(ast);
+        if (!func)
+            return;
+        func = copy_func(func, cur_func->locals);
+        for (int i = 0; i < vec_len(ast->args); i++)
+            vec_push(out, make_decl(vec_get(func->params, i), vec_get(ast->args, i)));
+        Ast *result = make_var(ast->ctype, "inline");
+        vec_push(cur_func->locals, result);
+        vec_push(out, make_decl(result, NULL));
+        Vector *stmts = func->body->stmts;
+        stmts->body[vec_len(stmts) - 1] = make_assign(result, result_expr(func));
+        vec_push(out, func->body);
+        *p = result;
+        return;
+    }
+    default:
+        inline_calls(&ast->left, out);
+        inline_calls(&ast->right, out);
+    }
+}
+
+static void inline_stmt(Ast **p);
+
+// 内联语句中的调用，展开的语句放在它前面
+static void inline_into(Ast *ast, Vector *out)
+{
+    switch (ast->type)
+    {
+    case AST_DECL:
+        inline_calls(&ast->decl_init, out);
+        break;
+    case AST_IF:
+        inline_calls(&ast->cond, out);
+        inline_stmt(&ast->then);
+        inline_stmt(&ast->els);
+        break;
+    case AST_FOR:
+        inline_calls(ast->forinit && ast->forinit->type == AST_DECL ? &ast->forinit->decl_init : &ast->forinit, out);
+        inline_stmt(&ast->forbody);
+        break;
+    case AST_RET:
+        inline_calls(&ast->retval, out);
+        break;
+    case AST_COMPOUND_STMT:
+        inline_stmt(&ast);
+        break;
+    default:
+        inline_calls(&ast, out);
+    }
+    vec_push(out, ast);
+}
+
+/**
+ * @brief 内联语句 *p 中的调用
+ * 块中的语句逐条展开，变量声明仍然留在原来的块中
+ * if 和 for 中不是块的语句有调用展开时，换成一个块
+ */
+static void inline_stmt(Ast **p)
+{
+    Ast *ast = *p;
+    if (!ast)
+        return;
+    Vector *out = make_vector();
+    if (ast->type != AST_COMPOUND_STMT)
+    {
+        inline_into(ast, out);
+        if (vec_len(out) > 1)
+            *p = make_compound(out);
+        return;
+    }
+    for (int i = 0; i < vec_len(ast->stmts); i++)
+        inline_into(vec_get(ast->stmts, i), out);
+    ast->stmts = out;
+}
+
+/**
+ * @brief 在生成代码之前优化函数的抽象语法树
+ * 先内联调用，再展开循环，展开之后的循环体再做循环不变量外提
+ */
+void optimize_func(Ast *func)
+{
+    cur_func = func;
+    if (flag_inline_functions)
+    {
+        inline_stmt(&func->body);
+        add_inline_func(func);
+    }
+    if (!flag_licm && !flag_unroll_loops)
+        return;
+    addr_taken = make_vector();
+    collect_vars(func->body, NULL, addr_taken);
+    if (flag_unroll_loops)
+        unroll_stmt(&func->body);
+    if (flag_licm)
+        licm_stmt(func->body);
+}
@@ -17,12 +17,13 @@
 #define MAX_ARGS 6
 
 // 全局变量表
-List *globals = EMPTY_LIST;
+Vector *globals = EMPTY_VECTOR;
+// 字符串常量表，所有函数输出完之后统一输出到 .rodata
+Vector *strings = EMPTY_VECTOR;
 
-// 当前函数的局部变量、参数表
-// 每解析完一个函数，这两个变量就清空
-List *locals = EMPTY_LIST;
-List *fparams = EMPTY_LIST;
+// 当前函数的局部变量表，用于分配栈空间
+// 每解析完一个函数，就清空
+Vector *locals = NULL;
 
 // int, char 类型
 Ctype *ctype_int = &(Ctype){CTYPE_INT, NULL};
@@ -51,7 +52,7 @@ static void expect(int punct);
  */
 static Ast *make_ast_uop(int type, Ctype *ctype, Ast *operand)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = type;
     r->ctype = ctype;
     r->operand = operand;
@@ -63,7 +64,7 @@ static Ast *make_ast_uop(int type, Ctype *ctype, Ast *operand)
  */
 static Ast *make_ast_binop(int type, Ast *left, Ast *right)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = type;
     r->ctype = result_type(type, left->ctype, right->ctype);
     // 指针运算，确保左子树是指针类型，方便后续操作
@@ -83,7 +84,7 @@ static Ast *make_ast_binop(int type, Ast *left, Ast *right)
 
 static Ast *make_ast_char(char c)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_LITERAL;
     r->ctype = ctype_char;
     r->c = c;
@@ -92,7 +93,7 @@ static Ast *make_ast_char(char c)
 
 static Ast *make_ast_int(int val)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_LITERAL;
     r->ctype = ctype_int;
     r->ival = val;
@@ -106,42 +107,54 @@ char *make_next_label(void)
     return get_cstring(s);
 }
 
-// 字符串本质上是全局字符数组
-static Ast *make_ast_str(char *str)
+/**
+ * 字符串本质上是全局字符数组
+ * 字符串常量在函数输出之后仍然要用到，因此放在 perm_arena 中
+ */
+static Ast *make_ast_str(Token *tok)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Arena *saved = cur_arena;
+    cur_arena = perm_arena;
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_STRING;
-    r->ctype = make_array_type(ctype_char, strlen(str) + 1);
-    r->sval = str;
+    r->sval = token_sval(tok);
+    r->ctype = make_array_type(ctype_char, strlen(r->sval) + 1);
     r->slabel = make_next_label();
-    list_append(globals, r);
+    vec_push(strings, r);
+    cur_arena = saved;
     return r;
 }
 
 static Ast *make_ast_lvar(Ctype *ctype, char *name)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_LVAR;
     r->ctype = ctype;
     r->lname = name;
-    if(locals) list_append(locals, r);
+    r->lreg = NULL;
+    r->luses = 0;
+    if(locals) vec_push(locals, r);
     return r;
 }
 
+// 全局变量在整个编译过程中都可能被引用，放在 perm_arena 中
 static Ast *make_ast_gvar(Ctype *ctype, char *name, bool filelocal)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Arena *saved = cur_arena;
+    cur_arena = perm_arena;
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_GVAR;
     r->ctype = ctype;
     r->gname = name;
     r->glabel = filelocal ? make_next_label() : name;
-    list_append(globals, r);
+    vec_push(globals, r);
+    cur_arena = saved;
     return r;
 }
 
-static Ast *make_ast_funcall(Ctype *ctype, char *fname, List *args)
+static Ast *make_ast_funcall(Ctype *ctype, char *fname, Vector *args)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_FUNCALL;
     r->ctype = ctype;
     r->fname = fname;
@@ -149,8 +162,8 @@ static Ast *make_ast_funcall(Ctype *ctype, char *fname, List *args)
     return r;
 }
 
-static Ast *make_ast_funcdef(Ctype *rettype, char *fname, List *params, Ast *body, List *locals){
-    Ast *r = malloc(sizeof(Ast));
+static Ast *make_ast_funcdef(Ctype *rettype, char *fname, Vector *params, Ast *body, Vector *locals){
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_FUNCDEF;
     r->ctype = rettype;
     r->fname = fname;
@@ -162,7 +175,7 @@ static Ast *make_ast_funcdef(Ctype *rettype, char *fname, List *params, Ast *bod
 
 static Ast *make_ast_decl(Ast *var, Ast *init)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_DECL;
     r->ctype = NULL;
     r->decl_var = var;
@@ -173,17 +186,17 @@ static Ast *make_ast_decl(Ast *var, Ast *init)
 /**
  * @array_init 大括号{}中数组元素的初始化值
  */
-static Ast *make_ast_array_init(List *array_init)
+static Ast *make_ast_array_init(Vector *array_init)
 {
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_ARRAY_INIT;
     r->ctype = NULL;
     r->array_init = array_init;
     return r;
 }
 
-static Ast *make_compound_stmt(List *stmts){
-    Ast *r = malloc(sizeof(Ast));
+static Ast *make_compound_stmt(Vector *stmts){
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_COMPOUND_STMT;
     r->ctype = NULL;
     r->stmts = stmts;
@@ -191,7 +204,7 @@ static Ast *make_compound_stmt(List *stmts){
 }
 
 static Ast *make_if_stmt(Ast *cond, Ast *then, Ast *els){
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_IF;
     r->ctype = NULL;
     r->cond = cond;
@@ -201,7 +214,7 @@ static Ast *make_if_stmt(Ast *cond, Ast *then, Ast *els){
 }
 
 static Ast *make_for_stmt(Ast *forinit, Ast *forcond, Ast *forstep, Ast *forbody){
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_FOR;
     r->ctype = NULL;
     r->forinit = forinit;
@@ -212,7 +225,7 @@ static Ast *make_for_stmt(Ast *forinit, Ast *forcond, Ast *forstep, Ast *forbody
 }
 
 static Ast *make_ret_stmt(Ast *retval){
-    Ast *r = malloc(sizeof(Ast));
+    Ast *r = qalloc(sizeof(Ast));
     r->type = AST_RET;
     r->ctype = NULL;
     r->retval = retval;
@@ -220,45 +233,74 @@ static Ast *make_ret_stmt(Ast *retval){
 }
 
 /**
- * @brief 创建数组类型
- * @param ele_ctype 数组元素的类型
+ * 类型表，每种类型只存在唯一的实例
+ * 因此判断两个类型是否相同只需要比较指针
+ * 只有指针和数组类型需要放进表里，int、char 本身就是唯一的
  */
-static Ctype *make_array_type(Ctype *elm_ctype, int size)
+static Ctype **ctypes;
+static int nctypes;
+static int ctypes_cap;
+
+static unsigned hash_ctype(int type, Ctype *ptr, int size)
 {
-    Ctype *r = malloc(sizeof(Ctype));
-    r->type = CTYPE_ARRAY;
-    r->ptr = elm_ctype;
+    unsigned h = (unsigned)type * 0x9e3779b1u;
+    h = (h ^ (unsigned)((size_t)ptr >> 4)) * 0x85ebca6bu;
+    return (h ^ (unsigned)size) * 0xc2b2ae35u;
+}
+
+static void rehash_ctypes(void)
+{
+    Ctype **old = ctypes;
+    int oldcap = ctypes_cap;
+    ctypes_cap = oldcap ? oldcap << 1 : 64;
+    ctypes = perm_alloc(ctypes_cap * sizeof(Ctype *));
+    memset(ctypes, 0, ctypes_cap * sizeof(Ctype *));
+    for (int i = 0; i < oldcap; i++)
+    {
+        Ctype *t = old[i];
+        if (!t)
+            continue;
+        int j = hash_ctype(t->type, t->ptr, t->size) & (ctypes_cap - 1);
+        while (ctypes[j])
+            j = (j + 1) & (ctypes_cap - 1);
+        ctypes[j] = t;
+    }
+}
+
+// 在类型表中查找类型，不存在则创建
+static Ctype *intern_ctype(int type, Ctype *ptr, int size)
+{
+    if ((nctypes + 1) * 2 > ctypes_cap)
+        rehash_ctypes();
+    int i = hash_ctype(type, ptr, size) & (ctypes_cap - 1);
+    for (; ctypes[i]; i = (i + 1) & (ctypes_cap - 1))
+    {
+        Ctype *t = ctypes[i];
+        if (t->type == type && t->ptr == ptr && t->size == size)
+            return t;
+    }
+    Ctype *r = perm_alloc(sizeof(Ctype));
+    r->type = type;
+    r->ptr = ptr;
     r->size = size;
+    ctypes[i] = r;
+    nctypes++;
     return r;
 }
 
-// ptr_ctype是指针所指向变量的 ctype
-static Ctype *make_ptr_type(Ctype *ptr_ctype)
+/**
+ * @brief 创建数组类型
+ * @param ele_ctype 数组元素的类型
+ */
+static Ctype *make_array_type(Ctype *elm_ctype, int size)
 {
-    Ctype *r = malloc(sizeof(Ctype));
-    r->type = CTYPE_PTR;
-    r->ptr = ptr_ctype;
-    return r;
+    return intern_ctype(CTYPE_ARRAY, elm_ctype, size);
 }
 
-static Ast *find_var(char *name)
+// ptr_ctype是指针所指向变量的 ctype
+static Ctype *make_ptr_type(Ctype *ptr_ctype)
 {
-    // 先遍历locals
-    for(Iter *i = list_iter(locals); !iter_end(i);){
-        Ast *var = iter_next(i);
-        if(!strcmp(name, var->lname)) return var;
-    }
-    // 再遍历 fparams
-    for(Iter *i = list_iter(fparams); !iter_end(i); ){
-        Ast *var = iter_next(i);
-        if(!strcmp(name, var->lname)) return var;
-    }
-    // 再遍历 globals
-    for(Iter *i = list_iter(globals); !iter_end(i);){
-        Ast *var = iter_next(i);
-        if(!strcmp(name, var->gname)) return var;
-    }
-    return NULL;
+    return intern_ctype(CTYPE_PTR, ptr_ctype, 0);
 }
 
 static int priority(int op)
@@ -287,7 +329,7 @@ static int priority(int op)
  */
 static Ast *parse_func_args(char *fname)
 {
-    List *args = make_list();
+    Vector *args = make_vector();
     int i = 0;
     for (; i < MAX_ARGS + 1; i++)
     {
@@ -298,7 +340,7 @@ static Ast *parse_func_args(char *fname)
         Token *tok = read_token();
         if (is_punct(tok, ')')) break;
         unget_token(tok);
-        list_append(args, parse_expr(0));
+        vec_push(args, parse_expr(0));
         tok = read_token();
         if (is_punct(tok, ')'))
             break;
@@ -328,7 +370,7 @@ static Ast *parse_ident_or_func(char *name)
         return parse_func_args(name);
     // identifier
     unget_token(tok);
-    Ast *v = find_var(name);
+    Ast *v = symtab_lookup(name);
     // must declaration before using.
     if (!v)
         error("Undefined varaible: %s", name);
@@ -353,9 +395,11 @@ static Ast *parse_prim(void)
     case TTYPE_CHAR:
         return make_ast_char(tok->c);
     case TTYPE_STRING:
-        return make_ast_str(tok->sval);
+        return make_ast_str(tok);
     case TTYPE_PUNCT:
         error("unexpected character: '%c'", tok->punct);
+    case TTYPE_KEYWORD:
+        error("unexpected keyword: %s", token_to_string(tok));
     default:
         error("internal error: unknown token type: %d", tok->type);
     }
@@ -365,6 +409,21 @@ static Ast *parse_prim(void)
  * 类型检查，推断当前二元表达式树的类型
  * 根据左右子树的类型推断
  */
+// result_type 的结果缓存，直接映射
+#define RESULT_CACHE_SIZE 256
+
+typedef struct
+{
+    int op;
+    Ctype *a, *b;
+    Ctype *result;
+    // 推断过程中是否产生了警告，命中缓存时需要再次给出
+    bool warned;
+} ResultCache;
+
+static ResultCache result_cache[RESULT_CACHE_SIZE];
+static bool result_warned;
+
 static Ctype *result_type_int(jmp_buf *jmpbuf, int op, Ctype *a, Ctype *b)
 {
     if (a->type > b->type)
@@ -381,13 +440,11 @@ static Ctype *result_type_int(jmp_buf *jmpbuf, int op, Ctype *a, Ctype *b)
         if (a->type != CTYPE_PTR)
         {
             warn("Making a pointer from %s\n", ctype_to_string(a));
+            result_warned = true;
             return b;
         }
         /* 二者都是指针的情况，递归下去看指向的变量类型 */
-        Ctype *r = malloc(sizeof(Ctype));
-        r->type = CTYPE_PTR;
-        r->ptr = result_type_int(jmpbuf, op, a->ptr, b->ptr);
-        return r;
+        return make_ptr_type(result_type_int(jmpbuf, op, a->ptr, b->ptr));
     }
 
     switch (a->type)
@@ -421,9 +478,27 @@ err:
 
 static Ctype *result_type(int op, Ctype *a, Ctype *b)
 {
+    // 类型都是唯一的，(op, a, b) 相同则结果一定相同，直接查缓存
+    int h = hash_ctype(op, a, (int)((size_t)b >> 4)) & (RESULT_CACHE_SIZE - 1);
+    ResultCache *c = &result_cache[h];
+    if (c->result && c->op == op && c->a == a && c->b == b)
+    {
+        if (c->warned)
+            warn("Making a pointer from %s\n", ctype_to_string(a->type < b->type ? a : b));
+        return c->result;
+    }
     jmp_buf jmpbuf;
     if (setjmp(jmpbuf) == 0)
-        return result_type_int(&jmpbuf, op, convert_array(a), convert_array(b));
+    {
+        result_warned = false;
+        Ctype *r = result_type_int(&jmpbuf, op, convert_array(a), convert_array(b));
+        c->op = op;
+        c->a = a;
+        c->b = b;
+        c->result = r;
+        c->warned = result_warned;
+        return r;
+    }
     error("incompatible operands: %c: <%s> and <%s>",
           op, ctype_to_string(a), ctype_to_string(b));
 }
@@ -576,12 +651,16 @@ static Ast *parse_expr(int prev_priority)
 
 static Ctype *get_ctype(Token *tok)
 {
-    if(!tok || tok->type != TTYPE_IDENT) return NULL;
-    if (!strcmp(tok->sval, "int"))
+    if(!tok || tok->type != TTYPE_KEYWORD) return NULL;
+    switch (tok->keyword)
+    {
+    case KW_INT:
         return ctype_int;
-    if (!strcmp(tok->sval, "char"))
+    case KW_CHAR:
         return ctype_char;
-    return NULL;
+    default:
+        return NULL;
+    }
 }
 
 static bool is_type_keyword(Token *tok)
@@ -606,11 +685,11 @@ static Ast *parse_decl_array_init(Ctype *ctype)
     Token *tok = read_token();
     // 字符数组
     if (ctype->ptr->type == CTYPE_CHAR && tok->type == TTYPE_STRING)
-        return make_ast_str(tok->sval);
+        return make_ast_str(tok);
     // 其它数组
     if (!is_punct(tok, '{'))
         error("Expected an initializer list, but got %s", token_to_string(tok));
-    List *initlist = make_list();
+    Vector *initlist = make_vector();
     int i = 0;
     for (i = 0; ; i++)
     {
@@ -619,7 +698,7 @@ static Ast *parse_decl_array_init(Ctype *ctype)
         unget_token(tok);
         Ast *init_val = parse_expr(0);
         if(!init_val) error("Unexpected terminate");
-        list_append(initlist, init_val);
+        vec_push(initlist, init_val);
         // 保证初始化元素类型 和 数组元素类型兼容
         result_type('=', init_val->ctype, ctype->ptr);
         tok = read_token();
@@ -652,9 +731,10 @@ static Ast *parse_decl_init_value(Ast *var)
         init = parse_decl_array_init(var->ctype);
         int len = (init->type == AST_STRING)
             ? strlen(init->sval) + 1
-            : list_len(init->array_init);
+            : vec_len(init->array_init);
+        // 类型是共享的，不能直接修改，换成确定了大小的数组类型
         if(var->ctype->size == -1){
-            var->ctype->size = len;
+            var->ctype = make_array_type(var->ctype->ptr, len);
         }
         return init;
     }
@@ -722,6 +802,7 @@ static Ast *parse_decl_var(bool isglobal){
     Ast *var;
     if(!isglobal) var = make_ast_lvar(ctype, varname->sval);
     else var = make_ast_gvar(ctype, varname->sval, false);
+    symtab_define(varname->sval, var);
     return var;
 }
 
@@ -757,7 +838,7 @@ static Ast *parse_if_stmt(){
     expect(')');
     Ast *then = parse_stmt();
     Token *tok = read_token();
-    if(!tok || !is_ident(tok, "else")){
+    if(!tok || !is_keyword(tok, KW_ELSE)){
         unget_token(tok);
         return make_if_stmt(cond, then, NULL);
     }
@@ -766,9 +847,11 @@ static Ast *parse_if_stmt(){
 
 /**
  * @brief for_stmt := for ( decl_or_stmt; expr; expr ) stmt
+ * init 中声明的变量只在 for 语句内部可见
  */
 static Ast *parse_for_stmt(){
     expect('(');
+    symtab_push_scope();
     Ast *init = NULL, *cond = NULL, *step = NULL;
     /* init */
     Token *tok = read_token();
@@ -785,6 +868,7 @@ static Ast *parse_for_stmt(){
     if(!is_punct(tok, ')')) step = parse_expr(0);
     expect(')');
     Ast *body = parse_stmt();
+    symtab_pop_scope();
     return make_for_stmt(init, cond, step, body);
 }
 
@@ -804,9 +888,13 @@ static Ast *parse_returen_stmt(){
 static Ast *parse_stmt()
 {
     Token *tok = read_token();
-    if(is_ident(tok, "if")) return parse_if_stmt();
-    if(is_ident(tok, "for")) return parse_for_stmt();
-    if(is_ident(tok, "return")) return parse_returen_stmt();
+    if(tok && tok->type == TTYPE_KEYWORD){
+        switch(tok->keyword){
+        case KW_IF: return parse_if_stmt();
+        case KW_FOR: return parse_for_stmt();
+        case KW_RETURN: return parse_returen_stmt();
+        }
+    }
     if(is_punct(tok, '{')) return parse_compound_stmts();
     unget_token(tok);
     Ast *r = parse_expr(0);
@@ -830,28 +918,30 @@ Ast *parse_decl_or_stmt()
 
 /**
  * @brief parse statements in one block
- * surrounded by {}
+ * surrounded by {}, each block introduces a new scope
  * compound_stmts := { decl_or_stmt1, decl_or_stmt2, ... }
  */
 static Ast *parse_compound_stmts()
 {
-    List *list = make_list();
+    symtab_push_scope();
+    Vector *list = make_vector();
     for(;;){
         Ast *stmt = parse_decl_or_stmt();
         if(!stmt) error("expected }");
-        list_append(list, stmt);
+        vec_push(list, stmt);
         Token *tok = read_token();
         if(is_punct(tok, '}')) break;
         unget_token(tok);
     }
+    symtab_pop_scope();
     return make_compound_stmt(list);
 }
 
 /**
  * @brief function definition parameters
  */
-static List *parse_funcdef_params(){
-    List *params = make_list();
+static Vector *parse_funcdef_params(){
+    Vector *params = make_vector();
     Token *tok = read_token();
     if(is_punct(tok, ')')) return params;
     unget_token(tok);
@@ -859,7 +949,7 @@ static List *parse_funcdef_params(){
         Ast *var = parse_decl_var(false);
         // 如果var是数组类型，则转换为指针类型，否则计算形参大小以预分配栈空间时，按照数组类型计算就会出现大问题
         if(var->ctype->type == CTYPE_ARRAY) var->ctype = make_ptr_type(var->ctype->ptr);
-        list_append(params, var);
+        vec_push(params, var);
         tok = read_token();
         if(is_punct(tok, ')')) break;
         if(is_punct(tok, ',')){
@@ -876,14 +966,16 @@ static List *parse_funcdef_params(){
  * @brief function definition
  */
 static Ast *parse_funcdef(Ctype *rettype, char *fname){
-    // 初始化fparams 和 函数内部局部变量表
-    fparams = parse_funcdef_params();
-    locals = make_list();
+    // 形参单独位于一层作用域中
+    symtab_push_scope();
+    Vector *params = parse_funcdef_params();
+    // 初始化函数内部局部变量表
+    locals = make_vector();
     expect('{');
     Ast *body = parse_compound_stmts();
-    Ast *r = make_ast_funcdef(rettype, fname, fparams, body, locals);
-    // 将fparams 和 locals 置空
-    fparams = NULL;
+    Ast *r = make_ast_funcdef(rettype, fname, params, body, locals);
+    symtab_pop_scope();
+    // 将 locals 置空
     locals = NULL;
     return r;
 }
@@ -964,19 +1056,19 @@ static void ast_to_string_int(Ast *ast, String *buf)
         break;
     case AST_FUNCALL:
         string_appendf(buf, "(%s)%s(", ctype_to_string(ast->ctype), ast->fname);
-        for (Iter *i = list_iter(ast->args); !iter_end(i);) {
-            string_appendf(buf, "%s", ast_to_string(iter_next(i)));
-            if (!iter_end(i))
+        for (int i = 0; i < vec_len(ast->args); i++) {
+            string_appendf(buf, "%s", ast_to_string(vec_get(ast->args, i)));
+            if (i + 1 < vec_len(ast->args))
             string_appendf(buf, ",");
         }
         string_appendf(buf, ")");
         break;
     case AST_FUNCDEF: {
         string_appendf(buf, "(%s)%s(", ctype_to_string(ast->ctype), ast->fname);
-        for (Iter *i = list_iter(ast->params); !iter_end(i);) {
-            Ast *param = iter_next(i);
+        for (int i = 0; i < vec_len(ast->params); i++) {
+            Ast *param = vec_get(ast->params, i);
             string_appendf(buf, "%s %s", ctype_to_string(param->ctype), ast_to_string(param));
-            if (!iter_end(i))
+            if (i + 1 < vec_len(ast->params))
             string_appendf(buf, ",");
         }
         string_appendf(buf, ")");
@@ -1000,10 +1092,10 @@ static void ast_to_string_int(Ast *ast, String *buf)
         break;
     case AST_ARRAY_INIT:
         string_appendf(buf, "{");
-        for (Iter *i = list_iter(ast->array_init); !iter_end(i);)
+        for (int i = 0; i < vec_len(ast->array_init); i++)
         {
-            ast_to_string_int(iter_next(i), buf);
-            if (!iter_end(i))
+            ast_to_string_int(vec_get(ast->array_init, i), buf);
+            if (i + 1 < vec_len(ast->array_init))
                 string_appendf(buf, ",");
         }
         string_appendf(buf, "}");
@@ -1028,8 +1120,8 @@ static void ast_to_string_int(Ast *ast, String *buf)
         break;
     case AST_COMPOUND_STMT:
         string_appendf(buf, "{");
-        for (Iter *i = list_iter(ast->stmts); !iter_end(i);) {
-            ast_to_string_int(iter_next(i), buf);
+        for (int i = 0; i < vec_len(ast->stmts); i++) {
+            ast_to_string_int(vec_get(ast->stmts, i), buf);
             string_appendf(buf, ";");
         }
         string_appendf(buf, "}");
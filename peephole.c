@@ -0,0 +1,555 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 17:05:12
+ * @LastEditTime: 2026-10-17 17:05:12
+ * @LastEditors: QQYYHH
+ * @Description: peephole optimizer
+ * @FilePath: /pwn/qcc/peephole.c
+ * welcome to my github: https://github.com/QQYYHH
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "qcc.h"
+
+/**
+ * -fpeephole 时 emitf 不直接输出，而是把每一行汇编记录到指令链表中
+ * 一个顶层定义的代码生成结束后，按照规则表反复改写链表，直到没有规则可以匹配，再统一输出
+ */
+
+enum
+{
+    INSN,
+    INSN_LABEL,
+    // .text .global .string 等伪指令，原样输出
+    INSN_DIRECTIVE,
+};
+
+// 规则关心的操作码，其它指令都是 OP_OTHER
+enum
+{
+    OP_OTHER,
+    OP_MOV,
+    // movzb movzbl movslq 等扩展传送指令
+    OP_MOVX,
+    OP_LEA,
+    OP_XOR,
+    OP_ADD,
+    OP_IMUL,
+    OP_PUSH,
+    OP_POP,
+    OP_JMP,
+    // 条件跳转
+    OP_JCC,
+    OP_CALL,
+    OP_RET,
+    OP_LEAVE,
+    // cltd idiv 等隐式读写 rax 和 rdx 的指令
+    OP_IMPLICIT,
+    // rep movsb 等隐式读写 rax rcx rsi rdi 的串操作
+    OP_REP,
+};
+
+typedef struct Insn
+{
+    struct Insn *prev, *next;
+    int kind;
+    // 产生这条指令的 gen.c 行号
+    int line;
+    int opc;
+    char *op;
+    int nopnd;
+    // AT&T 语法，最后一个操作数是目的操作数
+    char *opnd[3];
+    // 操作数恰好是一个寄存器时的寄存器编号和宽度，否则为-1
+    signed char reg[3];
+    signed char width[3];
+    // 原始文本，指令被改写之后为NULL，输出时重新生成
+    char *text;
+} Insn;
+
+static Insn head = {&head, &head};
+
+// ===================== registers ====================
+
+static char *REG_NAMES[][4] = {
+    {"rax", "eax", "ax", "al"},
+    {"rbx", "ebx", "bx", "bl"},
+    {"rcx", "ecx", "cx", "cl"},
+    {"rdx", "edx", "dx", "dl"},
+    {"rsi", "esi", "si", "sil"},
+    {"rdi", "edi", "di", "dil"},
+    {"rbp", "ebp", "bp", "bpl"},
+    {"rsp", "esp", "sp", "spl"},
+    {"r8", "r8d", "r8w", "r8b"},
+    {"r9", "r9d", "r9w", "r9b"},
+    {"r10", "r10d", "r10w", "r10b"},
+    {"r11", "r11d", "r11w", "r11b"},
+    {"r12", "r12d", "r12w", "r12b"},
+    {"r13", "r13d", "r13w", "r13b"},
+    {"r14", "r14d", "r14w", "r14b"},
+    {"r15", "r15d", "r15w", "r15b"},
+};
+
+#define NREGS (sizeof(REG_NAMES) / sizeof(*REG_NAMES))
+#define RAX 0
+#define RDX 3
+#define RSP 7
+
+/**
+ * @brief 解析寄存器名
+ * @param width 输出寄存器的宽度，0 表示64位，1 表示32位，以此类推
+ * @return 寄存器编号，-1 表示不是寄存器
+ */
+static int reg_lookup(char *name, int len, int *width)
+{
+    if (len < 2 || len > 4)
+        return -1;
+    for (int i = 0; i < NREGS; i++)
+        for (int w = 0; w < 4; w++)
+            if (REG_NAMES[i][w][1] == name[1] && !strncmp(REG_NAMES[i][w], name, len) &&
+                !REG_NAMES[i][w][len])
+            {
+                if (width)
+                    *width = w;
+                return i;
+            }
+    return -1;
+}
+
+// 操作数中是否出现了 reg 或者它的一部分
+static bool mentions(char *opnd, int reg)
+{
+    for (char *p = opnd; (p = strchr(p, '%'));)
+    {
+        char *q = ++p;
+        while (isalnum(*q))
+            q++;
+        if (reg_lookup(p, q - p, NULL) == reg)
+            return true;
+        p = q;
+    }
+    return false;
+}
+
+static bool insn_mentions(Insn *p, int reg)
+{
+    for (int i = 0; i < p->nopnd; i++)
+        if (p->reg[i] == reg || (p->reg[i] < 0 && mentions(p->opnd[i], reg)))
+            return true;
+    return false;
+}
+
+static char *reg_name(int reg, int width)
+{
+    String *s = make_string();
+    string_appendf(s, "%%%s", REG_NAMES[reg][width]);
+    return get_cstring(s);
+}
+
+// ===================== instructions ====================
+
+static int classify(char *op)
+{
+    static struct
+    {
+        char *name;
+        int opc;
+    } ops[] = {
+        {"mov", OP_MOV}, {"lea", OP_LEA}, {"xor", OP_XOR}, {"add", OP_ADD},
+        {"imul", OP_IMUL}, {"push", OP_PUSH}, {"pop", OP_POP}, {"jmp", OP_JMP},
+        {"call", OP_CALL}, {"ret", OP_RET}, {"leave", OP_LEAVE}, {"cltd", OP_IMPLICIT},
+        {"cqo", OP_IMPLICIT}, {"cltq", OP_IMPLICIT}, {"rep", OP_REP},
+    };
+    for (int i = 0; i < sizeof(ops) / sizeof(*ops); i++)
+        if (!strcmp(op, ops[i].name))
+            return ops[i].opc;
+    if (!strncmp(op, "movz", 4) || !strncmp(op, "movs", 4))
+        return OP_MOVX;
+    if (!strncmp(op, "idiv", 4) || !strncmp(op, "div", 3))
+        return OP_IMPLICIT;
+    if (op[0] == 'j')
+        return OP_JCC;
+    return OP_OTHER;
+}
+
+static void set_operand(Insn *p, int i, char *opnd)
+{
+    int w = -1;
+    p->opnd[i] = opnd;
+    p->reg[i] = opnd[0] == '%' ? reg_lookup(opnd + 1, strlen(opnd + 1), &w) : -1;
+    p->width[i] = w;
+    p->text = NULL;
+}
+
+static bool is_op(Insn *p, int opc)
+{
+    return p != &head && p->kind == INSN && p->opc == opc;
+}
+
+// 两个操作数的 mov 之类的指令
+static bool is_op2(Insn *p, int opc)
+{
+    return is_op(p, opc) && p->nopnd == 2;
+}
+
+static bool is_jump(Insn *p)
+{
+    return p->opc == OP_JMP || p->opc == OP_JCC;
+}
+
+// 改变控制流、使用栈或者隐式使用寄存器的指令，规则不跨越这些指令
+static bool is_barrier(Insn *p)
+{
+    if (p == &head || p->kind != INSN)
+        return true;
+    switch (p->opc)
+    {
+    case OP_JMP:
+    case OP_JCC:
+    case OP_CALL:
+    case OP_RET:
+    case OP_LEAVE:
+    case OP_PUSH:
+    case OP_POP:
+    case OP_IMPLICIT:
+    case OP_REP:
+        return true;
+    }
+    return false;
+}
+
+// 指令是否在不读取 reg 的情况下把 reg 整个覆盖（32位写会清零高32位）
+static bool kills(Insn *p, int reg)
+{
+    if (p->opc == OP_POP)
+        return p->reg[0] == reg;
+    if (p->nopnd != 2)
+        return false;
+    if (p->opc == OP_XOR)
+        return p->reg[0] == reg && p->reg[1] == reg;
+    if (p->opc != OP_MOV && p->opc != OP_LEA && p->opc != OP_MOVX)
+        return false;
+    if (p->reg[1] != reg || p->width[1] > 1)
+        return false;
+    return p->reg[0] != reg && (p->reg[0] >= 0 || !mentions(p->opnd[0], reg));
+}
+
+/**
+ * @brief reg 在 p 之后是否不再被使用，只在基本块内向后查找，遇到跳转或标签时保守地认为仍然被使用
+ */
+static bool dead_after(Insn *p, int reg)
+{
+    for (p = p->next; p != &head; p = p->next)
+    {
+        if (p->kind != INSN || is_jump(p) || p->opc == OP_CALL || p->opc == OP_RET ||
+            p->opc == OP_LEAVE || p->opc == OP_REP)
+            return false;
+        if (p->opc == OP_IMPLICIT && (reg == RAX || reg == RDX))
+            return false;
+        if (insn_mentions(p, reg))
+            return kills(p, reg);
+    }
+    return false;
+}
+
+static void delete(Insn *p)
+{
+    p->prev->next = p->next;
+    p->next->prev = p->prev;
+}
+
+// ===================== rules ====================
+
+// mov %rax, %rax
+static int rule_self_move(Insn *p)
+{
+    if (!is_op2(p, OP_MOV) || p->reg[0] < 0 || p->width[0] != 0 || p->reg[0] != p->reg[1] ||
+        p->width[1] != 0)
+        return 0;
+    delete(p);
+    return 1;
+}
+
+// mov A, B; mov B, A  =>  mov A, B
+static int rule_move_back(Insn *p)
+{
+    Insn *q = p->next;
+    if (!is_op2(p, OP_MOV) || !is_op2(q, OP_MOV))
+        return 0;
+    if (strcmp(p->opnd[0], q->opnd[1]) || strcmp(p->opnd[1], q->opnd[0]))
+        return 0;
+    // mov (%rax), %rax 之后 (%rax) 已经指向别处，第二条指令不是多余的
+    if (p->reg[1] >= 0 && mentions(p->opnd[0], p->reg[1]))
+        return 0;
+    // 写32位寄存器会清零高32位，第二条指令不是多余的
+    if (q->reg[1] >= 0 && q->width[1] != 0)
+        return 0;
+    delete(q);
+    return 1;
+}
+
+/**
+ * push %a; ...; pop %b  =>  mov %a, %b; ...
+ * 中间的指令不能使用 %b 和栈指针
+ */
+static int rule_push_pop(Insn *p)
+{
+    if (!is_op(p, OP_PUSH) || p->reg[0] < 0)
+        return 0;
+    Insn *q = p->next;
+    for (int n = 0; n < 4 && !is_op(q, OP_POP); n++, q = q->next)
+        if (is_barrier(q))
+            return 0;
+    if (!is_op(q, OP_POP) || q->reg[0] < 0)
+        return 0;
+    for (Insn *r = p->next; r != q; r = r->next)
+        if (insn_mentions(r, q->reg[0]) || insn_mentions(r, RSP))
+            return 0;
+    delete(q);
+    if (p->reg[0] == q->reg[0])
+    {
+        delete(p);
+        return 2;
+    }
+    p->opc = OP_MOV;
+    p->op = "mov";
+    p->nopnd = 2;
+    set_operand(p, 1, q->opnd[0]);
+    return 1;
+}
+
+/**
+ * mov %rax, %rbx; pop %rax; add %rbx, %rax  =>  pop %rbx; add %rbx, %rax
+ * 加法和乘法满足交换律，要求 %rbx 之后不再被使用
+ */
+static int rule_commute_pop(Insn *p)
+{
+    if (!is_op2(p, OP_MOV) || p->reg[0] < 0 || p->reg[1] < 0 || p->width[0] || p->width[1])
+        return 0;
+    Insn *q = p->next, *r = q->next;
+    if (!is_op(q, OP_POP) || (!is_op2(r, OP_ADD) && !is_op2(r, OP_IMUL)))
+        return 0;
+    if (q->reg[0] != p->reg[0] || r->reg[0] != p->reg[1] || r->width[0] ||
+        r->reg[1] != p->reg[0] || r->width[1] || !dead_after(r, p->reg[1]))
+        return 0;
+    set_operand(q, 0, p->opnd[1]);
+    delete(p);
+    return 1;
+}
+
+/**
+ * mov S, %ebx; mov %rbx, %rax  =>  mov S, %eax
+ * 要求 %rbx 之后不再被使用
+ */
+static int rule_forward_load(Insn *p)
+{
+    if ((!is_op2(p, OP_MOV) && !is_op2(p, OP_LEA)) || p->reg[1] < 0 || p->width[1] > 1)
+        return 0;
+    Insn *q = p->next;
+    int t = p->reg[1], x;
+    if (!is_op2(q, OP_MOV) || q->reg[0] != t || q->width[0] != 0 || (x = q->reg[1]) < 0 ||
+        q->width[1] != 0)
+        return 0;
+    if (x == t || x == RSP || !dead_after(q, t))
+        return 0;
+    set_operand(p, 1, reg_name(x, p->width[1]));
+    delete(q);
+    return 1;
+}
+
+/**
+ * xor %rax, %rax; mov S, %eax  =>  mov S, %eax
+ * 32位和64位的写入会覆盖整个寄存器
+ */
+static int rule_dead_xor(Insn *p)
+{
+    if (!is_op2(p, OP_XOR) || p->reg[0] < 0 || p->reg[0] != p->reg[1])
+        return 0;
+    Insn *q = p->next;
+    if (is_barrier(q) || !kills(q, p->reg[0]))
+        return 0;
+    delete(p);
+    return 1;
+}
+
+// jmp L; L:  =>  L:
+static int rule_jump_next(Insn *p)
+{
+    if (!is_op(p, OP_JMP))
+        return 0;
+    int len = strlen(p->opnd[0]);
+    for (Insn *q = p->next; q != &head && q->kind == INSN_LABEL; q = q->next)
+        if (!strncmp(q->text, p->opnd[0], len) && q->text[len] == ':')
+        {
+            delete(p);
+            return 1;
+        }
+    return 0;
+}
+
+// jmp 和 ret 之后直到下一个标签之前的指令不可达
+static int rule_unreachable(Insn *p)
+{
+    if (!is_op(p, OP_JMP) && !is_op(p, OP_RET))
+        return 0;
+    int n = 0;
+    while (p->next != &head && p->next->kind == INSN)
+    {
+        delete(p->next);
+        n++;
+    }
+    return n;
+}
+
+#define OPS(x) (1 << (x))
+
+/**
+ * 规则表，每个规则检查从 p 开始的几条指令，匹配时改写链表，返回删除的指令条数
+ * ops 是规则的第一条指令可能的操作码，只对这些指令尝试规则
+ */
+static struct
+{
+    char *name;
+    unsigned ops;
+    int (*fn)(Insn *p);
+    // 累计删除的指令条数
+    long count;
+} rules[] = {
+    {"self-move", OPS(OP_MOV), rule_self_move},
+    {"move-back", OPS(OP_MOV), rule_move_back},
+    {"push-pop", OPS(OP_PUSH), rule_push_pop},
+    {"commute-pop", OPS(OP_MOV), rule_commute_pop},
+    {"forward-load", OPS(OP_MOV) | OPS(OP_LEA), rule_forward_load},
+    {"dead-xor", OPS(OP_XOR), rule_dead_xor},
+    {"jump-next", OPS(OP_JMP), rule_jump_next},
+    {"unreachable", OPS(OP_JMP) | OPS(OP_RET), rule_unreachable},
+};
+
+#define NRULES (sizeof(rules) / sizeof(*rules))
+
+// ===================== buffer ====================
+
+static char *skip_space(char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+// 按不在括号中的逗号拆分操作数
+static void parse_operands(Insn *insn, char *p)
+{
+    insn->nopnd = 0;
+    p = skip_space(p);
+    while (*p && insn->nopnd < 3)
+    {
+        char *opnd = p;
+        int depth = 0;
+        for (; *p && (*p != ',' || depth); p++)
+            depth += (*p == '(') - (*p == ')');
+        if (*p)
+            *p++ = '\0';
+        set_operand(insn, insn->nopnd++, opnd);
+        p = skip_space(p);
+    }
+}
+
+/**
+ * @brief 记录一行汇编代码，指令和拆分后的操作数一起分配
+ */
+void peephole_record(int line, char *text)
+{
+    int len = strlen(text);
+    Insn *insn = qalloc(sizeof(Insn) + (len + 1) * 2);
+    char *copy = (char *)(insn + 1);
+    memcpy(copy, text, len + 1);
+    insn->line = line;
+    insn->nopnd = 0;
+    insn->op = NULL;
+    insn->opc = OP_OTHER;
+    if (text[0] != '\t')
+        insn->kind = INSN_LABEL;
+    else if (text[1] == '.')
+        insn->kind = INSN_DIRECTIVE;
+    else
+    {
+        insn->kind = INSN;
+        char *p = copy + len + 1;
+        memcpy(p, text + 1, len);
+        insn->op = p;
+        while (*p && *p != ' ' && *p != '\t')
+            p++;
+        if (*p)
+            *p++ = '\0';
+        insn->opc = classify(insn->op);
+        parse_operands(insn, p);
+    }
+    insn->text = copy;
+    insn->prev = head.prev;
+    insn->next = &head;
+    head.prev->next = insn;
+    head.prev = insn;
+}
+
+// 规则最多检查的指令条数，改写之后回退这么多条指令重新匹配
+#define WINDOW 6
+
+static void optimize(void)
+{
+    for (Insn *p = head.next; p != &head; p = p->next)
+        for (int i = 0; i < NRULES; i++)
+        {
+            if (p->kind != INSN || !(rules[i].ops & OPS(p->opc)))
+                continue;
+            Insn *prev = p->prev;
+            int n = rules[i].fn(p);
+            if (!n)
+                continue;
+            rules[i].count += n;
+            // p 可能已经被删除，改写可能让前面的指令形成新的匹配
+            for (int k = 0; k < WINDOW && prev != &head; k++)
+                prev = prev->prev;
+            p = prev->next;
+            if (p == &head)
+                break;
+            i = -1;
+        }
+}
+
+/**
+ * @brief 优化记录下来的指令并输出，必须在释放指令所在的arena之前调用
+ */
+void peephole_flush(void)
+{
+    if (head.next == &head)
+        return;
+    optimize();
+    for (Insn *p = head.next; p != &head; p = p->next)
+    {
+        if (p->text)
+        {
+            emit_line(p->line, p->text);
+            continue;
+        }
+        String *s = make_string();
+        string_appendf(s, "\t%s", p->op);
+        for (int i = 0; i < p->nopnd; i++)
+            string_appendf(s, "%s%s", i ? ", " : " ", p->opnd[i]);
+        emit_line(p->line, get_cstring(s));
+    }
+    head.next = head.prev = &head;
+}
+
+// -fpeephole-report: 输出每条规则删除的指令条数
+void peephole_report(FILE *fp)
+{
+    long total = 0;
+    for (int i = 0; i < NRULES; i++)
+    {
+        fprintf(fp, "  %-13s: %ld instructions eliminated\n", rules[i].name, rules[i].count);
+        total += rules[i].count;
+    }
+    fprintf(fp, "  %-13s: %ld instructions eliminated\n", "total", total);
+}
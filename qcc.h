@@ -11,7 +11,9 @@
 #define QCC_H
 
 #include <stdbool.h>
-#include "list.h"
+#include <stddef.h>
+#include <stdio.h>
+#include "vector.h"
 
 // ============================ Token ================================
 enum
@@ -22,11 +24,25 @@ enum
     TTYPE_INT,
     TTYPE_CHAR,
     TTYPE_STRING,
+    TTYPE_KEYWORD,
+};
+
+// 关键字，在词法分析阶段就已经识别出来
+enum
+{
+    KW_IF,
+    KW_ELSE,
+    KW_FOR,
+    KW_RETURN,
+    KW_INT,
+    KW_CHAR,
 };
 
 typedef struct
 {
     int type;
+    // 字符串常量在源码中的长度，sval 指向源码中的位置
+    int len;
     union
     {
         int ival;
@@ -34,6 +50,7 @@ typedef struct
         // + - * / ( ) , {} ; 等其它一些特殊符号
         int punct;
         char c;
+        int keyword;
     };
 } Token;
 
@@ -116,6 +133,12 @@ typedef struct Ast
             char *lname;
             // 局部变量相对rbp的偏移
             int loff;
+            // 提升到寄存器中的局部变量所在的寄存器，NULL表示在栈上
+            char *lreg;
+            // 加权后的使用次数，-1 表示变量被取了地址，不能放在寄存器中
+            int luses;
+            // 中间表示中的SSA变量编号，-1 表示变量在栈上，见 ir.c
+            int lid;
         };
         // Global Variable
         struct
@@ -141,13 +164,13 @@ typedef struct Ast
             union
             {
                 // function call args
-                struct List *args;
+                struct Vector *args;
                 struct
                 {
                     // function definition parameters.
-                    struct List *params;
+                    struct Vector *params;
                     // locals variables in the function
-                    struct List *locals;
+                    struct Vector *locals;
                     struct Ast *body;
                 };
             };
@@ -160,7 +183,7 @@ typedef struct Ast
         };
         // Array Initializer
         // 大括号{}中 对数组进行初始化的 ast指针数组
-        struct List *array_init;
+        struct Vector *array_init;
 
         // if statement
         struct
@@ -180,7 +203,7 @@ typedef struct Ast
         // ret statement 
         struct Ast *retval;
         /* compound statements(statements in one function or block) */ 
-        struct List *stmts;
+        struct Vector *stmts;
     };
 } Ast;
 
@@ -208,19 +231,39 @@ typedef struct Ast
 extern void errorf(char *file, int line, char *fmt, ...) __attribute__((noreturn));
 // extern void warn(char *fmt, ...) __attribute__((noreturn));
 
+typedef struct Arena Arena;
+extern Arena *perm_arena;
+extern Arena *cur_arena;
+extern Arena *make_arena(void);
+extern void *arena_alloc(Arena *arena, size_t size);
+extern void arena_reset(Arena *arena);
+extern void arena_release(Arena *arena);
+extern void arena_report(char *name, Arena *arena, FILE *fp);
+extern void *perm_alloc(size_t size);
+extern void *qalloc(size_t size);
+
 extern String *make_string(void);
 extern char *get_cstring(String *s);
 extern void string_append(String *s, char c);
 extern void string_appendf(String *s, char *fmt, ...);
 
+extern void lex_init(char *filename);
 extern char *token_to_string(Token *tok);
+extern char *token_sval(Token *tok);
 extern bool is_punct(Token *tok, int c);
-extern bool is_ident(Token *tok, char *s);
+extern bool is_keyword(Token *tok, int kw);
+extern char *intern(char *s);
 extern void unget_token(Token *tok);
 extern Token *peek_token(void);
+extern Token *peek_token_n(int n);
 extern Token *read_token(void);
 
 extern char *quote(char *);
+extern void emit_flush(void);
+extern void emit_line(int line, char *text);
+extern void peephole_record(int line, char *text);
+extern void peephole_flush(void);
+extern void peephole_report(FILE *fp);
 extern char *make_next_label(void);
 
 extern void emit_expr(Ast *ast);
@@ -229,11 +272,44 @@ extern char *ctype_to_string(Ctype *ctype);
 extern Ast *parse_decl_or_funcdef();
 extern void emit_toplevel(Ast *ast);
 extern void emit_data_section_str();
+extern int ctype_size(Ctype *ctype);
+extern bool emit_ir(Ast *func);
+extern void optimize_func(Ast *func);
 
 extern Ast *parse_decl_or_stmt(void);
 
-extern List *globals;
-extern List *locals;
+extern void symtab_push_scope(void);
+extern void symtab_pop_scope(void);
+extern void symtab_define(char *name, Ast *var);
+extern Ast *symtab_lookup(char *name);
+
+// 编译选项，见 main.c
+extern bool flag_verbose_asm;
+extern bool flag_register_expr;
+extern bool flag_promote_regs;
+extern bool flag_ssa;
+extern bool flag_dump_ir;
+extern bool flag_peephole;
+extern bool flag_scaled_index;
+extern bool flag_strength_reduce;
+extern bool flag_compare_branch;
+extern bool flag_rotate_loops;
+extern bool flag_licm;
+extern bool flag_unroll_loops;
+extern bool flag_call_args;
+extern bool flag_omit_leaf_frame;
+extern bool flag_pack_frame;
+extern bool flag_bulk_init;
+extern bool flag_inline_functions;
+extern bool flag_sibling_calls;
+// 部分展开时循环体复制的份数，见 opt.c
+extern int unroll_factor;
+// 可以内联的函数体的最大节点数，见 opt.c
+extern int inline_limit;
+
+extern Vector *globals;
+extern Vector *strings;
+extern Vector *locals;
 extern Ctype *ctype_int;
 extern Ctype *ctype_char;
 
@@ -17,17 +17,20 @@
 #define INIT_SIZE 8
 
 String *make_string(){
-  String *r = malloc(sizeof(String));
-  r->body = malloc(INIT_SIZE);
+  String *r = qalloc(sizeof(String));
+  r->body = qalloc(INIT_SIZE);
   r->nalloc = INIT_SIZE;
   r->len = 0;
   r->body[0] = '\0';
   return r;
 }
 
+// arena中的内存不能realloc，申请一块两倍大小的新内存再拷贝过去
 static void realloc_body(String *s){
     int newsize = (s->nalloc << 1);
-    s->body = realloc(s->body, newsize);
+    char *body = qalloc(newsize);
+    memcpy(body, s->body, s->len + 1);
+    s->body = body;
     s->nalloc = newsize;
 }
 
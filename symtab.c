@@ -0,0 +1,110 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 11:40:03
+ * @LastEditTime: 2026-10-17 11:40:03
+ * @LastEditors: QQYYHH
+ * @Description: scoped symbol table
+ * @FilePath: /pwn/qcc/symtab.c
+ * welcome to my github: https://github.com/QQYYHH
+ */
+
+#include <stdlib.h>
+#include "qcc.h"
+
+#define MAX_SCOPE_DEPTH 256
+
+/**
+ * 符号表：哈希表 + 符号栈
+ * 名字都经过了intern，因此直接对指针做哈希，比较时也只比较指针
+ * 新定义的符号插在哈希链的头部，自然会遮盖外层作用域的同名符号
+ * 退出作用域时，按定义的相反顺序把符号从链头摘掉即可
+ */
+typedef struct
+{
+    char *name;
+    Ast *var;
+    // 同一哈希链中的下一个符号在 syms 中的下标，-1 表示结束
+    int next;
+} Symbol;
+
+static Symbol *syms;
+static int nsyms;
+static int syms_cap;
+
+static int *buckets;
+static int nbuckets;
+
+// 每一层作用域开始时符号栈的高度
+static int scopes[MAX_SCOPE_DEPTH];
+static int depth;
+
+static unsigned hash_ptr(char *name)
+{
+    size_t h = (size_t)name >> 3;
+    return (unsigned)(h * 0x9e3779b97f4a7c15ull >> 32);
+}
+
+static void rehash(void)
+{
+    nbuckets = nbuckets ? nbuckets << 1 : 256;
+    free(buckets);
+    buckets = malloc(nbuckets * sizeof(int));
+    for (int i = 0; i < nbuckets; i++)
+        buckets[i] = -1;
+    // 按定义顺序重新插入，保证内层符号仍然在链头
+    for (int i = 0; i < nsyms; i++)
+    {
+        int b = hash_ptr(syms[i].name) & (nbuckets - 1);
+        syms[i].next = buckets[b];
+        buckets[b] = i;
+    }
+}
+
+void symtab_push_scope(void)
+{
+    if (depth == MAX_SCOPE_DEPTH)
+        error("Too many nested scopes");
+    scopes[depth++] = nsyms;
+}
+
+void symtab_pop_scope(void)
+{
+    assert(depth > 0);
+    int base = scopes[--depth];
+    while (nsyms > base)
+    {
+        Symbol *sym = &syms[--nsyms];
+        int b = hash_ptr(sym->name) & (nbuckets - 1);
+        buckets[b] = sym->next;
+    }
+}
+
+// 在当前作用域中定义符号
+void symtab_define(char *name, Ast *var)
+{
+    if (nsyms == syms_cap)
+    {
+        syms_cap = syms_cap ? syms_cap << 1 : 256;
+        syms = realloc(syms, syms_cap * sizeof(Symbol));
+    }
+    if (nsyms >= nbuckets)
+        rehash();
+    int b = hash_ptr(name) & (nbuckets - 1);
+    Symbol *sym = &syms[nsyms];
+    sym->name = name;
+    sym->var = var;
+    sym->next = buckets[b];
+    buckets[b] = nsyms++;
+}
+
+// 由内向外查找符号，找不到返回NULL
+Ast *symtab_lookup(char *name)
+{
+    if (!nbuckets)
+        return NULL;
+    int i = buckets[hash_ptr(name) & (nbuckets - 1)];
+    for (; i >= 0; i = syms[i].next)
+        if (syms[i].name == name)
+            return syms[i].var;
+    return NULL;
+}
@@ -10,7 +10,7 @@
 ### 
 
 function compile {
-  ./qcc < "$1" > tmp.s
+  ./qcc $QCCFLAGS "$1" > tmp.s
   if [ $? -ne 0 ]; then
     echo "Failed to compile $1"
     exit
@@ -10,6 +10,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 #include "qcc.h"
 
 void assert_equal(char *s, char *t)
@@ -32,9 +33,84 @@ void test_string()
     assert_equal("ab.0123456789", get_cstring(s));
 }
 
+void test_vector()
+{
+    Vector *v = make_vector();
+    char *elems[] = {"a", "b", "c", "d", "e", "f", "g", "h", "i", "j"};
+    for (int i = 0; i < 10; i++)
+        vec_push(v, elems[i]);
+    if (vec_len(v) != 10)
+        error("Expected 10 elements but got %d", vec_len(v));
+    for (int i = 0; i < 10; i++)
+        assert_equal(elems[i], vec_get(v, i));
+    if (vec_len(EMPTY_VECTOR) != 0)
+        error("Expected an empty vector");
+}
+
+void test_intern()
+{
+    char buf[] = "abc";
+    char *a = intern("abc");
+    if (a != intern(buf))
+        error("Expected the same pointer for interned names");
+    if (a == intern("abcd"))
+        error("Expected different pointers for different names");
+    assert_equal("abc", a);
+}
+
+void test_arena()
+{
+    Arena *arena = make_arena();
+    char *a = arena_alloc(arena, 24);
+    char *b = arena_alloc(arena, 24);
+    char *big = arena_alloc(arena, 1 << 20);
+    if ((size_t)a % 16 || (size_t)b % 16 || (size_t)big % 16)
+        error("Expected 16-byte aligned arena memory");
+    if (b - a < 24)
+        error("Arena allocations overlap");
+    big[(1 << 20) - 1] = 1;
+    arena_release(arena);
+}
+
+/**
+ * @brief 经过窥孔优化输出 lines，返回输出的汇编代码
+ */
+char *peephole_lines(char **lines, int n)
+{
+    static char buf[256];
+    int fds[2], saved = dup(1);
+    if (pipe(fds) < 0)
+        error("pipe failed");
+    dup2(fds[1], 1);
+    for (int i = 0; i < n; i++)
+        peephole_record(0, lines[i]);
+    emit_flush();
+    dup2(saved, 1);
+    close(fds[1]);
+    close(saved);
+    int len = read(fds[0], buf, sizeof(buf) - 1);
+    close(fds[0]);
+    buf[len > 0 ? len : 0] = '\0';
+    return buf;
+}
+
+void test_peephole()
+{
+    char *load[] = {"\tmov (%rax), %rax", "\tmov %rax, (%rax)"};
+    assert_equal("\tmov (%rax), %rax\n\tmov %rax, (%rax)\n", peephole_lines(load, 2));
+    char *copy[] = {"\tmov %rcx, %rax", "\tmov %rax, %rcx"};
+    assert_equal("\tmov %rcx, %rax\n", peephole_lines(copy, 2));
+    char *tab[] = {"\tmov\t%rax, %rax"};
+    assert_equal("", peephole_lines(tab, 1));
+}
+
 int main(int argc, char **argv)
 {
     test_string();
+    test_vector();
+    test_intern();
+    test_arena();
+    test_peephole();
     printf("Unittest Passed\n");
     return 0;
 }
\ No newline at end of file
@@ -11,9 +11,33 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
 #include "qcc.h"
 
 #define TAB 8
+
+// 编译选项，由 main.c 根据命令行设置
+bool flag_verbose_asm;
+bool flag_register_expr;
+bool flag_promote_regs;
+bool flag_ssa;
+bool flag_dump_ir;
+bool flag_peephole;
+bool flag_scaled_index;
+bool flag_strength_reduce;
+bool flag_compare_branch;
+bool flag_rotate_loops;
+bool flag_licm;
+bool flag_unroll_loops;
+bool flag_call_args;
+bool flag_omit_leaf_frame;
+bool flag_pack_frame;
+bool flag_bulk_init;
+bool flag_inline_functions;
+bool flag_sibling_calls;
+
 void errorf(char *file, int line, char *fmt, ...) {
   fprintf(stderr, "%s:%d: ", file, line);
   va_list args;
@@ -33,17 +57,91 @@ void errorf(char *file, int line, char *fmt, ...) {
 //   va_end(args);
 // }
 
+/**
+ * 汇编代码先格式化到输出缓冲区中，缓冲区满了或者编译结束时再调用write一次性写出
+ * 避免每一行代码都要经过stdio
+ */
+#define OUTBUF_SIZE (1 << 20)
+// 一般的汇编代码格式化到栈上这么大的缓冲区中，更长的行（比如长字符串常量）另外分配
+#define MAX_LINE 512
+// -fverbose-asm 注释占用的最大长度：对齐的空格、'#' 和行号
+#define ANNOTATION_SIZE 48
+
+static char outbuf[OUTBUF_SIZE];
+static int outlen;
+
+static void write_all(char *p, int len) {
+  while (len > 0) {
+    ssize_t n = write(STDOUT_FILENO, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      error("write: %s", strerror(errno));
+    }
+    p += n;
+    len -= n;
+  }
+}
+
+static void flush_outbuf(void) {
+  write_all(outbuf, outlen);
+  outlen = 0;
+}
+
+void emit_flush(void) {
+  peephole_flush();
+  flush_outbuf();
+}
+
+/**
+ * @brief 把一行汇编代码追加到输出缓冲区
+ * @param line 产生这行代码的gen.c行号，-fverbose-asm 时注释在行尾
+ */
+void emit_line(int line, char *text) {
+  int col = strlen(text);
+  // 缓冲区要放下这一行、行尾注释和换行符，放不下整个缓冲区的行直接写出
+  if (OUTBUF_SIZE - outlen < col + ANNOTATION_SIZE + 1)
+    flush_outbuf();
+  if (col + ANNOTATION_SIZE + 1 > OUTBUF_SIZE) {
+    write_all(text, col);
+  } else {
+    memcpy(outbuf + outlen, text, col);
+    outlen += col;
+  }
+
+  // -fverbose-asm: 在每一行的末尾注释产生这行代码的gen.c行号
+  if (flag_verbose_asm) {
+    for (char *p = text; *p; p++)
+      if (*p == '\t')
+        col += TAB - 1;
+    // space 不超过30，" %d" 不超过12个字符
+    int space = (30 - col) > 0 ? (30 - col) : 2;
+    memset(outbuf + outlen, ' ', space - 1);
+    outlen += space - 1;
+    outbuf[outlen++] = '#';
+    outlen += snprintf(outbuf + outlen, OUTBUF_SIZE - outlen, " %d", line);
+  }
+  outbuf[outlen++] = '\n';
+}
+
 void emitf(int line, char *fmt, ...) {
+  char stackbuf[MAX_LINE];
+  char *buf = stackbuf;
   va_list args;
   va_start(args, fmt);
-  int col = vprintf(fmt, args);
+  int len = vsnprintf(buf, MAX_LINE, fmt, args);
   va_end(args);
-
-  for (char *p = fmt; *p; p++)
-    if (*p == '\t')
-      col += TAB - 1;
-  int space = (30 - col) > 0 ? (30 - col) : 2;
-  printf("%*c %d\n", space, '#', line);
+  if (len >= MAX_LINE) {
+    buf = qalloc(len + 1);
+    va_start(args, fmt);
+    vsnprintf(buf, len + 1, fmt, args);
+    va_end(args);
+  }
+  // -fpeephole: 先记录下来，由 peephole_flush 优化之后再输出
+  if (flag_peephole)
+    peephole_record(line, buf);
+  else
+    emit_line(line, buf);
 }
 
 char *quote(char *p)
@@ -0,0 +1,38 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 11:02:15
+ * @LastEditTime: 2026-10-17 11:02:15
+ * @LastEditors: QQYYHH
+ * @Description: vector structure implement
+ * @FilePath: /pwn/qcc/vector.c
+ * welcome to my github: https://github.com/QQYYHH
+ */
+#include <string.h>
+#include "qcc.h"
+
+#define INIT_SIZE 8
+
+Vector *make_vector(void){
+    Vector *r = qalloc(sizeof(Vector));
+    r->len = 0;
+    r->nalloc = 0;
+    r->body = NULL;
+    r->arena = cur_arena;
+    return r;
+}
+
+// arena中的内存不能realloc，容量不够时申请两倍大小的新数组再拷贝过去
+// 新数组和原数组在同一个arena中，保证生命周期一致
+static void extend(Vector *vec){
+    int newsize = vec->nalloc ? vec->nalloc << 1 : INIT_SIZE;
+    size_t size = newsize * sizeof(void *);
+    void **body = vec->arena ? arena_alloc(vec->arena, size) : perm_alloc(size);
+    if(vec->len) memcpy(body, vec->body, vec->len * sizeof(void *));
+    vec->body = body;
+    vec->nalloc = newsize;
+}
+
+void vec_push(Vector *vec, void *elem){
+    if(vec->len == vec->nalloc) extend(vec);
+    vec->body[vec->len++] = elem;
+}
@@ -0,0 +1,36 @@
+/*
+ * @Author: QQYYHH
+ * @Date: 2026-10-17 11:02:15
+ * @LastEditTime: 2026-10-17 11:02:15
+ * @LastEditors: QQYYHH
+ * @Description: vector structure
+ * @FilePath: /pwn/qcc/vector.h
+ * welcome to my github: https://github.com/QQYYHH
+ */
+#ifndef VECTOR_H
+#define VECTOR_H
+
+// 可增长的连续数组，元素为指针
+typedef struct Vector{
+    int len;
+    int nalloc;
+    void **body;
+    // 数组所在的arena，为NULL时使用 perm_arena
+    struct Arena *arena;
+}Vector;
+
+Vector *make_vector(void);
+void vec_push(Vector *vec, void *elem);
+
+static inline int vec_len(Vector *vec){
+    return vec->len;
+}
+
+static inline void *vec_get(Vector *vec, int index){
+    return vec->body[index];
+}
+
+#define EMPTY_VECTOR                                    \
+    (&(Vector){ .len = 0, .nalloc = 0, .body = NULL, .arena = NULL })
+
+#endif /* VECTOR_H */